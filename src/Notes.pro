@@ -14,6 +14,13 @@ TARGET    = Notes
 TEMPLATE  = app
 CONFIG   += c++11
 
+# zstd compresses large note bodies faster than zlib, use it when it's installed
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += NOTES_WITH_ZSTD
+}
+
 UI_DIR = uic
 MOC_DIR = moc
 RCC_DIR = qrc
@@ -27,9 +34,13 @@ include ($$PWD/../3rdParty/qautostart/src/qautostart.pri)
 SOURCES += \
     $$PWD/main.cpp\
     $$PWD/mainwindow.cpp \
+    $$PWD/editjournal.cpp \
+    $$PWD/notebackup.cpp \
     $$PWD/notedata.cpp \
+    $$PWD/notedelta.cpp \
     $$PWD/notewidgetdelegate.cpp \
     $$PWD/notemodel.cpp \
+    $$PWD/notefilterproxymodel.cpp \
     $$PWD/noteview.cpp \
     $$PWD/singleinstance.cpp \
     $$PWD/updaterwindow.cpp \
@@ -37,9 +48,13 @@ SOURCES += \
 
 HEADERS  += \
     $$PWD/mainwindow.h \
+    $$PWD/editjournal.h \
+    $$PWD/notebackup.h \
     $$PWD/notedata.h \
+    $$PWD/notedelta.h \
     $$PWD/notewidgetdelegate.h \
     $$PWD/notemodel.h \
+    $$PWD/notefilterproxymodel.h \
     $$PWD/noteview.h \
     $$PWD/singleinstance.h \
     $$PWD/updaterwindow.h \
@@ -1,30 +1,275 @@
 #include "dbmanager.h"
+#include "notedelta.h"
+#include "notebackup.h"
 #include <QtSql/QSqlQuery>
 #include <QTimeZone>
 #include <QDateTime>
 #include <QDebug>
 #include <QSqlError>
+#include <QCryptographicHash>
+#include <QtEndian>
 #include <QtConcurrent>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <functional>
+
+#ifdef NOTES_WITH_ZSTD
+#include <zstd.h>
+#include <climits>
+#define ZSTD_COMPRESSION_LEVEL 3
+#endif
+
+#define SCHEMA_VERSION 8
+#define BACKFILL_BATCH_SIZE 2000
+#define NOTES_PAGE_SIZE 500
+#define MAX_REVISION_DELTA_CHAIN 512
+#define BODY_COMPRESSION_THRESHOLD 4096
+#define JOB_PROGRESS_INTERVAL 100
+#define BULK_INSERT_ROWS 150
+#define IMPORT_BATCH_SIZE 2000
+#define INDEX_REBUILD_MIN_FRACTION 4
+#define PARALLEL_HASH_THRESHOLD 256
+#define WAL_CHECKPOINT_INTERVAL 30000
+#define WAL_AUTOCHECKPOINT_PAGES 10000
+#define PAGE_CACHE_SIZE_KIB 8192
+#define MMAP_SIZE (64 * 1024 * 1024)
+#define TRASH_RETENTION_INTERVAL (60 * 60 * 1000)
+#define TRASH_RETENTION_START_DELAY 10000
+#define TRASH_PURGE_BATCH_SIZE 500
+#define VACUUM_PAGES_PER_STEP 256
+#define IDLE_RETRY_DELAY 1000
+#define SAVE_RETRY_DELAY 5000
+#define READER_CONNECTION_COUNT 3
+#define WRITTEN_BODIES_MAX 16
 
 /*!
  * \brief DBManager::DBManager
  * \param parent
  */
 DBManager::DBManager(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      m_writeBehindTimer(new QTimer(this)),
+      m_saveRetryTimer(new QTimer(this)),
+      m_walCheckpointTimer(new QTimer(this)),
+      m_trashRetentionTimer(new QTimer(this)),
+      m_readerPool(new QThreadPool(this)),
+      m_durabilityProfile(DurabilityProfile::Balanced),
+      m_bodyCompression(BodyCompression::Zlib),
+      m_isUpsertSupported(false),
+      m_hasFullTextIndex(false),
+      m_isFullTextSearchAvailable(false),
+      m_fullTextBackfillNextId(1),
+      m_fullTextBackfillEndId(0),
+      m_isJobCancelled(0),
+      m_isBulkLoading(false),
+      m_isModificationIndexDropped(false),
+      m_isBulkDeduplicating(false),
+      m_bulkNotesInserted(0),
+      m_bulkNotesSkipped(0),
+      m_bulkNotesMerged(0),
+      m_bulkLoadFirstId(1),
+      m_bulkLoadNextId(1),
+      m_trashMaxAgeDays(0),
+      m_trashMaxNotes(0),
+      m_isTrashRetentionRunning(false),
+      m_trashNotesPurged(0),
+      m_trashPageCountBefore(0)
 {
     qRegisterMetaType<QList<NoteData*> >("QList<NoteData*>");
+    qRegisterMetaType<QList<int> >("QList<int>");
+    qRegisterMetaType<QList<qint64> >("QList<qint64>");
+
+    m_writeBehindTimer->setSingleShot(true);
+    connect(m_writeBehindTimer, &QTimer::timeout, this, &DBManager::flushPendingSaves);
+
+    m_saveRetryTimer->setSingleShot(true);
+    m_saveRetryTimer->setInterval(SAVE_RETRY_DELAY);
+    connect(m_saveRetryTimer, &QTimer::timeout, this, &DBManager::flushPendingSaves);
+
+    m_walCheckpointTimer->setInterval(WAL_CHECKPOINT_INTERVAL);
+    connect(m_walCheckpointTimer, &QTimer::timeout, this, [this](){checkpointWal(false);});
+
+    // reader threads keep their connection, so they must never expire
+    m_readerPool->setMaxThreadCount(READER_CONNECTION_COUNT);
+    m_readerPool->setExpiryTimeout(-1);
+
+    m_trashRetentionTimer->setInterval(TRASH_RETENTION_INTERVAL);
+    connect(m_trashRetentionTimer, &QTimer::timeout, this, [this](){
+        if(!m_isTrashRetentionRunning)
+            purgeTrashBatch();
+    });
+
+    setDurabilityProfile(DurabilityProfile::Balanced);
+}
+
+/*!
+ * \brief DBManager::~DBManager
+ * Commit the saves that are still waiting in the write-behind queue
+ * and fold the write-ahead log back into the database file
+ */
+DBManager::~DBManager()
+{
+    flushPendingSaves();
+    // the journal of the application still has the edits that failed
+    qDeleteAll(m_pendingSaves);
+    m_pendingSaves.clear();
+
+    m_readerPool->waitForDone();
+    for(const QString& name : m_readerConnectionNames)
+        QSqlDatabase::removeDatabase(name);
+
+    if(QSqlDatabase::database().isOpen())
+        checkpointWal(true);
+}
+
+/*!
+ * \brief DBManager::setDurabilityProfile
+ * Choose how often saves reach the disk.
+ * Safe commits every save right away with a full fsync,
+ * Balanced batches saves for half a second and lets the WAL sync at checkpoints,
+ * Fast batches saves for two seconds.
+ * Must be called before the database is opened
+ * \param profile
+ */
+void DBManager::setDurabilityProfile(DurabilityProfile profile)
+{
+    m_durabilityProfile = profile;
+
+    switch(profile){
+    case DurabilityProfile::Safe:
+        m_writeBehindTimer->setInterval(0);
+        break;
+    case DurabilityProfile::Balanced:
+        m_writeBehindTimer->setInterval(500);
+        break;
+    case DurabilityProfile::Fast:
+        m_writeBehindTimer->setInterval(2000);
+        break;
+    }
+}
+
+/*!
+ * \brief DBManager::durabilityProfileFromString
+ * \param name
+ * \return the profile named 'name', Balanced if the name is unknown
+ */
+DBManager::DurabilityProfile DBManager::durabilityProfileFromString(const QString& name)
+{
+    if(name.compare(QStringLiteral("safe"), Qt::CaseInsensitive) == 0)
+        return DurabilityProfile::Safe;
+
+    if(name.compare(QStringLiteral("fast"), Qt::CaseInsensitive) == 0)
+        return DurabilityProfile::Fast;
+
+    return DurabilityProfile::Balanced;
+}
+
+/*!
+ * \brief DBManager::setBodyCompression
+ * Choose how the content of the notes larger than BODY_COMPRESSION_THRESHOLD
+ * characters is compressed when it is written.
+ * Bodies already stored keep their encoding until they are saved again
+ * \param compression
+ */
+void DBManager::setBodyCompression(BodyCompression compression)
+{
+    m_bodyCompression = compression;
+}
+
+/*!
+ * \brief DBManager::bodyCompressionFromString
+ * \param name
+ * \return the compression named 'name', Zlib if the name is unknown
+ */
+DBManager::BodyCompression DBManager::bodyCompressionFromString(const QString& name)
+{
+    if(name.compare(QStringLiteral("none"), Qt::CaseInsensitive) == 0)
+        return BodyCompression::None;
+
+    if(name.compare(QStringLiteral("zstd"), Qt::CaseInsensitive) == 0)
+        return BodyCompression::Zstd;
+
+    return BodyCompression::Zlib;
+}
+
+/*!
+ * \brief DBManager::setTrashRetention
+ * Limit how long and how many deleted notes are kept in the trash,
+ * 0 removes the limit. The trash is purged on the database thread
+ * shortly after opening and then every TRASH_RETENTION_INTERVAL.
+ * Must be called before the database is opened
+ * \param maxAgeDays
+ * \param maxNotes
+ */
+void DBManager::setTrashRetention(int maxAgeDays, int maxNotes)
+{
+    m_trashMaxAgeDays = qMax(0, maxAgeDays);
+    m_trashMaxNotes = qMax(0, maxNotes);
+}
+
+/*!
+ * \brief DBManager::cancelJob
+ * Stop the running export, import or restore job.
+ * Unlike the slots, it's meant to be called directly from any thread
+ */
+void DBManager::cancelJob()
+{
+    m_isJobCancelled.storeRelease(1);
+}
+
+/*!
+ * \brief stripNullChars
+ * SQLite text functions stop at an embedded null character, so remove them.
+ * The string is only detached when it actually contains one.
+ * \param str
+ * \return
+ */
+static QString stripNullChars(const QString& str)
+{
+    if(!str.contains(QChar('\x0')))
+        return str;
+
+    QString stripped = str;
+    return stripped.remove(QChar('\x0'));
+}
+
+/*!
+ * \brief DBManager::contentHash
+ * Two notes with the same title and content have the same hash
+ * \param title
+ * \param content
+ * \return the first 64 bits of the MD5 of the title and content as they are stored
+ */
+qint64 DBManager::contentHash(const QString& title, const QString& content)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(stripNullChars(title).toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(stripNullChars(content).toUtf8());
+    return qFromBigEndian<qint64>(reinterpret_cast<const uchar*>(hash.result().constData()));
+}
+
+/*!
+ * \brief noteContentHash
+ * \param note
+ * \return
+ */
+static qint64 noteContentHash(NoteData* note)
+{
+    return DBManager::contentHash(note->fullTitle(), note->content());
 }
 
 /*!
  * \brief DBManager::open
  * \param path
- * \param doCreate
  */
-void DBManager::open(const QString &path, bool doCreate)
+void DBManager::open(const QString &path)
 {
     QSqlDatabase m_db;
     m_db = QSqlDatabase::addDatabase("QSQLITE");
+    m_databasePath = path;
 
     m_db.setDatabaseName(path);
     if(!m_db.open()){
@@ -33,423 +278,2288 @@ void DBManager::open(const QString &path, bool doCreate)
         qDebug() << "Database: connection ok";
     }
 
-    if(doCreate)
-        createTables();
+    configureConnection();
+    migrateSchema();
+    updateFullTextSearchAvailability();
+    prepareQueries();
+
+    m_walCheckpointTimer->start();
+    m_trashRetentionTimer->start();
+    QTimer::singleShot(TRASH_RETENTION_START_DELAY, this, SLOT(purgeTrashBatch()));
+}
+
+/*!
+ * \brief DBManager::configureConnection
+ * Switch the connection to write-ahead logging and tune the page cache.
+ * In WAL mode synchronous=NORMAL only syncs at checkpoints,
+ * which are run by the checkpoint timer on the database thread
+ */
+void DBManager::configureConnection()
+{
+    QSqlQuery query;
+
+    query.exec(QStringLiteral("PRAGMA journal_mode = WAL"));
+    if(!query.next() || query.value(0).toString().compare(QStringLiteral("wal"), Qt::CaseInsensitive) != 0)
+        qWarning() << "DBManager::configureConnection: write-ahead logging is not available";
+    query.finish();
+
+    bool isSafe = (m_durabilityProfile == DurabilityProfile::Safe);
+    query.exec(isSafe ? QStringLiteral("PRAGMA synchronous = FULL")
+                      : QStringLiteral("PRAGMA synchronous = NORMAL"));
+
+    query.exec(QStringLiteral("PRAGMA cache_size = -%1").arg(PAGE_CACHE_SIZE_KIB));
+    query.exec(QStringLiteral("PRAGMA mmap_size = %1").arg(MMAP_SIZE));
+    query.exec(QStringLiteral("PRAGMA temp_store = MEMORY"));
+
+    // only takes effect on a new database, older ones are converted by vacuumStep
+    query.exec(QStringLiteral("PRAGMA auto_vacuum = INCREMENTAL"));
+
+    // checkpoints are driven by checkpointWal, the automatic one is only a safety net
+    query.exec(QStringLiteral("PRAGMA wal_autocheckpoint = %1").arg(WAL_AUTOCHECKPOINT_PAGES));
+}
+
+/*!
+ * \brief DBManager::checkpointWal
+ * Copy the write-ahead log back into the database file.
+ * A passive checkpoint never waits on readers,
+ * a truncating one also resets the log file and is used when closing
+ * \param truncate
+ */
+void DBManager::checkpointWal(bool truncate)
+{
+    QSqlQuery query;
+    bool ok = query.exec(truncate ? QStringLiteral("PRAGMA wal_checkpoint(TRUNCATE)")
+                                  : QStringLiteral("PRAGMA wal_checkpoint(PASSIVE)"));
+    if(!ok)
+        qWarning() << "DBManager::checkpointWal: " << query.lastError();
+}
+
+/*!
+ * \brief The ReaderTask class
+ * Run a function on a thread of the reader pool
+ */
+class ReaderTask : public QRunnable
+{
+public:
+    explicit ReaderTask(const std::function<void()>& function)
+        : m_function(function)
+    {}
+
+    void run() Q_DECL_OVERRIDE
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+/*!
+ * \brief DBManager::runOnReader
+ * Run 'function' on one of the READER_CONNECTION_COUNT reader threads,
+ * where readerConnection gives it a connection of its own
+ * \param function
+ */
+void DBManager::runOnReader(const std::function<void()>& function)
+{
+    m_readerPool->start(new ReaderTask(function));
+}
+
+/*!
+ * \brief DBManager::readerConnection
+ * Each reader thread opens its own read-only connection the first time it needs one.
+ * In WAL mode readers see the last commit and never wait on the writer, nor the writer on them
+ * \return the reader connection of the calling thread
+ */
+QSqlDatabase DBManager::readerConnection()
+{
+    QString name = QStringLiteral("notes_reader_%1").arg(quintptr(QThread::currentThreadId()));
+    if(QSqlDatabase::contains(name))
+        return QSqlDatabase::database(name);
+
+    QSqlDatabase database = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), name);
+    database.setDatabaseName(m_databasePath);
+    database.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
+    if(!database.open())
+        qWarning() << "DBManager::readerConnection: " << database.lastError();
+
+    QSqlQuery query(database);
+    query.exec(QStringLiteral("PRAGMA cache_size = -%1").arg(PAGE_CACHE_SIZE_KIB));
+    query.exec(QStringLiteral("PRAGMA mmap_size = %1").arg(MMAP_SIZE));
+    query.exec(QStringLiteral("PRAGMA temp_store = MEMORY"));
+
+    QMutexLocker locker(&m_readerConnectionsMutex);
+    m_readerConnectionNames.append(name);
+    return database;
+}
+
+/*!
+ * \brief DBManager::readNoteContent
+ * Can be called from any thread. The body is read on the reader connection
+ * of the calling thread, so it doesn't wait for the saves and the jobs
+ * of the database thread. Saves still in the write-behind queue aren't seen
+ * \param id
+ * \return the content of the note as last committed
+ */
+QString DBManager::readNoteContent(int id)
+{
+    QSqlQuery query(readerConnection());
+    query.prepare(QStringLiteral("SELECT content, encoding FROM note_bodies WHERE note_id = :id"));
+    query.bindValue(QStringLiteral(":id"), id);
+    if(!query.exec()){
+        qWarning() << "DBManager::readNoteContent: " << query.lastError();
+        return QString();
+    }
+
+    return query.next() ? decodeNoteBody(query.value(0), query.value(1).toInt()) : QString();
+}
+
+/*!
+ * \brief DBManager::pragmaValue
+ * \param pragma
+ * \return the value of the pragma named 'pragma', 0 if it can't be read
+ */
+qint64 DBManager::pragmaValue(const QString& pragma)
+{
+    QSqlQuery query;
+    query.exec(QStringLiteral("PRAGMA %1").arg(pragma));
+    return query.next() ? query.value(0).toLongLong() : 0;
+}
+
+/*!
+ * \brief DBManager::isIdle
+ * \return false while saves are waiting to be written
+ */
+bool DBManager::isIdle() const
+{
+    return m_pendingSaves.isEmpty() && !m_writeBehindTimer->isActive();
+}
+
+/*!
+ * \brief DBManager::purgeTrashBatch
+ * Remove up to TRASH_PURGE_BATCH_SIZE deleted notes that are older than
+ * the retention age or beyond the retention count, oldest first.
+ * Batches are chained through the event loop so saves are never held back,
+ * and the freed pages are handed to vacuumStep once the trash is within its limits
+ */
+void DBManager::purgeTrashBatch()
+{
+    if(!isIdle()){
+        QTimer::singleShot(IDLE_RETRY_DELAY, this, SLOT(purgeTrashBatch()));
+        return;
+    }
+
+    if(!m_isTrashRetentionRunning){
+        m_isTrashRetentionRunning = true;
+        m_trashNotesPurged = 0;
+        m_trashPageCountBefore = pragmaValue(QStringLiteral("page_count"));
+    }
+
+    int removed = 0;
+    QSqlDatabase::database().transaction();
+
+    if(m_trashMaxAgeDays > 0){
+        qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - qint64(m_trashMaxAgeDays) * 24 * 60 * 60 * 1000;
+        m_purgeExpiredTrashQuery.bindValue(QStringLiteral(":cutoff"), cutoff);
+        m_purgeExpiredTrashQuery.bindValue(QStringLiteral(":batch"), TRASH_PURGE_BATCH_SIZE);
+        if(m_purgeExpiredTrashQuery.exec())
+            removed += m_purgeExpiredTrashQuery.numRowsAffected();
+        else
+            qWarning() << "DBManager::purgeTrashBatch: " << m_purgeExpiredTrashQuery.lastError();
+    }
+
+    if(m_trashMaxNotes > 0 && removed < TRASH_PURGE_BATCH_SIZE){
+        m_purgeExcessTrashQuery.bindValue(QStringLiteral(":keep"), m_trashMaxNotes);
+        m_purgeExcessTrashQuery.bindValue(QStringLiteral(":batch"), TRASH_PURGE_BATCH_SIZE - removed);
+        if(m_purgeExcessTrashQuery.exec())
+            removed += m_purgeExcessTrashQuery.numRowsAffected();
+        else
+            qWarning() << "DBManager::purgeTrashBatch: " << m_purgeExcessTrashQuery.lastError();
+    }
+
+    QSqlDatabase::database().commit();
+    m_trashNotesPurged += removed;
+
+    if(removed == TRASH_PURGE_BATCH_SIZE)
+        QTimer::singleShot(0, this, SLOT(purgeTrashBatch()));
+    else
+        QTimer::singleShot(0, this, SLOT(vacuumStep()));
+}
+
+/*!
+ * \brief DBManager::vacuumStep
+ * Give up to VACUUM_PAGES_PER_STEP free pages back to the file system, one slice
+ * per turn of the event loop while no save is waiting.
+ * A database created before incremental vacuum was enabled is converted by a full
+ * VACUUM, once a quarter of its pages are free.
+ * Reports the notes purged and the bytes reclaimed with trashPurged when done
+ */
+void DBManager::vacuumStep()
+{
+    if(!isIdle()){
+        QTimer::singleShot(IDLE_RETRY_DELAY, this, SLOT(vacuumStep()));
+        return;
+    }
+
+    qint64 freePages = pragmaValue(QStringLiteral("freelist_count"));
+
+    if(freePages > 0){
+        QSqlQuery query;
+
+        if(pragmaValue(QStringLiteral("auto_vacuum")) == 2){
+            // the pragma frees one page per step and QSqlQuery steps it only once per exec
+            QSqlDatabase::database().transaction();
+            query.prepare(QStringLiteral("PRAGMA incremental_vacuum"));
+            for(int i = 0; i < VACUUM_PAGES_PER_STEP && i < freePages; ++i){
+                if(!query.exec()){
+                    qWarning() << "DBManager::vacuumStep: " << query.lastError();
+                    break;
+                }
+            }
+            QSqlDatabase::database().commit();
+
+            if(freePages > VACUUM_PAGES_PER_STEP){
+                QTimer::singleShot(0, this, SLOT(vacuumStep()));
+                return;
+            }
+        }else if(freePages * 4 >= pragmaValue(QStringLiteral("page_count"))){
+            checkpointWal(true);
+            query.exec(QStringLiteral("PRAGMA auto_vacuum = INCREMENTAL"));
+            if(!query.exec(QStringLiteral("VACUUM")))
+                qWarning() << "DBManager::vacuumStep: " << query.lastError();
+        }
+    }
+
+    qint64 pagesReclaimed = qMax<qint64>(0, m_trashPageCountBefore - pragmaValue(QStringLiteral("page_count")));
+    qint64 bytesReclaimed = pagesReclaimed * pragmaValue(QStringLiteral("page_size"));
+    m_isTrashRetentionRunning = false;
+
+    emit trashPurged(m_trashNotesPurged, bytesReclaimed);
+}
+
+/*!
+ * \brief DBManager::execSchemaStatements
+ * \param statements
+ * \return false as soon as one of the statements fails
+ */
+bool DBManager::execSchemaStatements(const QStringList& statements)
+{
+    QSqlQuery query;
+    for(const QString& statement : statements){
+        if(!query.exec(statement)){
+            qWarning() << "DBManager::execSchemaStatements: " << query.lastError() << statement;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief DBManager::schemaVersion
+ * \return the version of the schema stored in the database header, 0 for databases
+ * created before the schema was versioned
+ */
+int DBManager::schemaVersion()
+{
+    QSqlQuery query(QStringLiteral("PRAGMA user_version"));
+    return query.next() ? query.value(0).toInt() : 0;
+}
+
+/*!
+ * \brief DBManager::migrateSchema
+ * Apply, in order, every migration step above the version of the database.
+ * Each step runs in its own transaction together with the version bump,
+ * so an interrupted upgrade restarts from the last completed step.
+ * Steps that have to go through every note only register a backfill,
+ * which is then run in batches from the event loop of the database thread
+ */
+void DBManager::migrateSchema()
+{
+    int version = schemaVersion();
+
+    while(version < SCHEMA_VERSION){
+        int nextVersion = version + 1;
+
+        QSqlDatabase::database().transaction();
+        bool migrated = applyMigrationStep(nextVersion)
+                && execSchemaStatements({QStringLiteral("PRAGMA user_version = %1").arg(nextVersion)});
+
+        if(!migrated){
+            QSqlDatabase::database().rollback();
+            qWarning() << "DBManager::migrateSchema: migration to version" << nextVersion << "failed";
+            break;
+        }
+
+        QSqlDatabase::database().commit();
+        version = nextVersion;
+    }
+
+    QTimer::singleShot(0, this, SLOT(runBackfillBatch()));
+}
+
+/*!
+ * \brief DBManager::applyMigrationStep
+ * \param version
+ * \return
+ */
+bool DBManager::applyMigrationStep(int version)
+{
+    switch(version){
+    case 1:
+        return createTables();
+    case 2:
+        // the notes list is read in modification date order straight from this index,
+        // the unique index on the primary key only duplicated the table
+        return execSchemaStatements({
+            QStringLiteral("CREATE INDEX IF NOT EXISTS active_notes_modification_index "
+                           "ON active_notes (modification_date DESC, id)"),
+            QStringLiteral("DROP INDEX IF EXISTS active_index")});
+    case 3:
+        return createFullTextIndex(QStringLiteral("active_notes"), QStringLiteral("id"),
+                                   {QStringLiteral("content"), QStringLiteral("full_title")});
+    case 4:
+        return splitNoteBodies();
+    case 5:
+        // every committed save of a note, see recordRevision
+        return execSchemaStatements({
+            QStringLiteral("CREATE TABLE note_revisions ("
+                           "note_id INTEGER NOT NULL,"
+                           "revision INTEGER NOT NULL,"
+                           "modification_date INTEGER NOT NULL DEFAULT (0),"
+                           "is_snapshot INTEGER NOT NULL DEFAULT (0),"
+                           "data BLOB,"
+                           "PRIMARY KEY (note_id, revision)) WITHOUT ROWID"),
+            QStringLiteral("CREATE TRIGGER active_notes_revisions_delete AFTER DELETE ON active_notes BEGIN "
+                           "DELETE FROM note_revisions WHERE note_id = old.id; "
+                           "END")});
+    case 6:
+        return compressNoteBodies();
+    case 7:
+        // the trash is purged oldest first, see purgeTrashBatch
+        return execSchemaStatements({
+            QStringLiteral("CREATE INDEX IF NOT EXISTS deleted_notes_deletion_index "
+                           "ON deleted_notes (deletion_date)")});
+    case 8:
+        // duplicates are found on import through this index, see bulkAddNotes
+        return execSchemaStatements({
+            QStringLiteral("ALTER TABLE active_notes ADD COLUMN content_hash INTEGER"),
+            QStringLiteral("CREATE INDEX active_notes_content_hash_index ON active_notes (content_hash)"),
+            QStringLiteral("INSERT INTO schema_backfill (name, next_id, end_id) "
+                           "SELECT 'content_hash', (SELECT MIN(id) FROM active_notes), (SELECT MAX(id) FROM active_notes) "
+                           "WHERE EXISTS (SELECT 1 FROM active_notes)")});
+    }
+
+    return false;
+}
+
+/*!
+ * \brief DBManager::createTables
+ * \return
+ */
+bool DBManager::createTables()
+{
+    QString active = "CREATE TABLE IF NOT EXISTS active_notes ("
+                     "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                     "creation_date INTEGER NOT NULL DEFAULT (0),"
+                     "modification_date INTEGER NOT NULL DEFAULT (0),"
+                     "deletion_date INTEGER NOT NULL DEFAULT (0),"
+                     "content TEXT, "
+                     "full_title TEXT);";
+
+    QString deleted = "CREATE TABLE IF NOT EXISTS deleted_notes ("
+                      "id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+                      "creation_date INTEGER NOT NULL DEFAULT (0),"
+                      "modification_date INTEGER NOT NULL DEFAULT (0),"
+                      "deletion_date INTEGER NOT NULL DEFAULT (0),"
+                      "content TEXT,"
+                      "full_title TEXT)";
+
+    // rows still to be processed by a backfill, see runBackfillBatch
+    QString backfill = "CREATE TABLE IF NOT EXISTS schema_backfill ("
+                       "name TEXT PRIMARY KEY,"
+                       "next_id INTEGER NOT NULL,"
+                       "end_id INTEGER NOT NULL)";
+
+    return execSchemaStatements({active, deleted, backfill});
+}
+
+/*!
+ * \brief DBManager::createFullTextIndex
+ * Create the FTS5 index of the notes over 'columns' of 'table',
+ * and the triggers keeping it in sync. The index is external content,
+ * it doesn't store the text a second time. The existing rows are indexed
+ * by the 'notes_fts' backfill, until it reaches them the triggers leave them alone.
+ * Without FTS5 in the SQLite library the step succeeds without an index
+ * \param table
+ * \param idColumn
+ * \param columns
+ * \return
+ */
+bool DBManager::createFullTextIndex(const QString& table, const QString& idColumn, const QStringList& columns)
+{
+    QString notYetBackfilled = QStringLiteral("EXISTS (SELECT 1 FROM schema_backfill "
+                                              "WHERE name = 'notes_fts' AND %1 BETWEEN next_id AND end_id)");
+    QString columnList = columns.join(QStringLiteral(", "));
+    QString newValues = QStringLiteral("new.") + columns.join(QStringLiteral(", new."));
+    QString oldValues = QStringLiteral("old.") + columns.join(QStringLiteral(", old."));
+
+    bool created = execSchemaStatements({
+        QStringLiteral("DROP TABLE IF EXISTS notes_fts"),
+        QStringLiteral("CREATE VIRTUAL TABLE notes_fts USING fts5(%1, content = '%2', content_rowid = '%3', "
+                       "prefix = '2 3')").arg(columnList, table, idColumn)});
+
+    if(!created){
+        qWarning() << "DBManager::createFullTextIndex: FTS5 is not available, "
+                      "search falls back to scanning the notes";
+        return true;
+    }
+
+    QString insertNew = QStringLiteral("INSERT INTO notes_fts (rowid, %1) VALUES (new.%2, %3); ")
+            .arg(columnList, idColumn, newValues);
+    QString deleteOld = QStringLiteral("INSERT INTO notes_fts (notes_fts, rowid, %1) VALUES ('delete', old.%2, %3); ")
+            .arg(columnList, idColumn, oldValues);
+
+    return execSchemaStatements({
+        QStringLiteral("CREATE TRIGGER %1_fts_insert AFTER INSERT ON %1 WHEN NOT %2 BEGIN %3END")
+                .arg(table, notYetBackfilled.arg(QStringLiteral("new.") + idColumn), insertNew),
+        QStringLiteral("CREATE TRIGGER %1_fts_delete AFTER DELETE ON %1 WHEN NOT %2 BEGIN %3END")
+                .arg(table, notYetBackfilled.arg(QStringLiteral("old.") + idColumn), deleteOld),
+        QStringLiteral("CREATE TRIGGER %1_fts_update AFTER UPDATE OF %2 ON %1 WHEN NOT %3 BEGIN %4%5END")
+                .arg(table, columnList, notYetBackfilled.arg(QStringLiteral("old.") + idColumn), deleteOld, insertNew),
+        QStringLiteral("DELETE FROM schema_backfill WHERE name = 'notes_fts'"),
+        QStringLiteral("INSERT INTO schema_backfill (name, next_id, end_id) "
+                       "SELECT 'notes_fts', (SELECT MIN(%2) FROM %1), (SELECT MAX(%2) FROM %1) "
+                       "WHERE EXISTS (SELECT 1 FROM %1)").arg(table, idColumn)});
+}
+
+/*!
+ * \brief DBManager::splitNoteBodies
+ * Move the content of the notes to note_bodies so that active_notes only
+ * holds small fixed size rows: listing, counting and sorting the notes then
+ * read a few pages whatever the amount of text stored.
+ * SQLite can't drop a column, active_notes is rebuilt without it
+ * \return
+ */
+bool DBManager::splitNoteBodies()
+{
+    bool split = execSchemaStatements({
+        QStringLiteral("DROP TABLE IF EXISTS notes_fts"),
+        QStringLiteral("CREATE TABLE note_bodies ("
+                       "note_id INTEGER PRIMARY KEY,"
+                       "content TEXT)"),
+        QStringLiteral("INSERT INTO note_bodies (note_id, content) SELECT id, content FROM active_notes"),
+        QStringLiteral("CREATE TABLE active_notes_narrow ("
+                       "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       "creation_date INTEGER NOT NULL DEFAULT (0),"
+                       "modification_date INTEGER NOT NULL DEFAULT (0),"
+                       "deletion_date INTEGER NOT NULL DEFAULT (0),"
+                       "full_title TEXT)"),
+        QStringLiteral("INSERT INTO active_notes_narrow (id, creation_date, modification_date, deletion_date, full_title) "
+                       "SELECT id, creation_date, modification_date, deletion_date, full_title FROM active_notes"),
+        // keep the ids of removed notes from being handed out again
+        QStringLiteral("DELETE FROM sqlite_sequence WHERE name = 'active_notes_narrow'"),
+        QStringLiteral("UPDATE sqlite_sequence SET name = 'active_notes_narrow' WHERE name = 'active_notes'"),
+        QStringLiteral("DROP TABLE active_notes"),
+        QStringLiteral("ALTER TABLE active_notes_narrow RENAME TO active_notes"),
+        QStringLiteral("CREATE INDEX active_notes_modification_index "
+                       "ON active_notes (modification_date DESC, id)"),
+        QStringLiteral("CREATE TRIGGER active_notes_body_delete AFTER DELETE ON active_notes BEGIN "
+                       "DELETE FROM note_bodies WHERE note_id = old.id; "
+                       "END")});
+
+    return split && createFullTextIndex(QStringLiteral("note_bodies"), QStringLiteral("note_id"),
+                                        {QStringLiteral("content")});
+}
+
+/*!
+ * \brief DBManager::compressNoteBodies
+ * Let note_bodies hold compressed content, flagged by its encoding column.
+ * SQL can't read compressed text, so the full text index becomes contentless
+ * and is kept up to date by DBManager itself, see indexNoteContent
+ * \return
+ */
+bool DBManager::compressNoteBodies()
+{
+    bool altered = execSchemaStatements({
+        QStringLiteral("ALTER TABLE note_bodies ADD COLUMN encoding INTEGER NOT NULL DEFAULT (0)"),
+        QStringLiteral("DROP TRIGGER IF EXISTS note_bodies_fts_insert"),
+        QStringLiteral("DROP TRIGGER IF EXISTS note_bodies_fts_delete"),
+        QStringLiteral("DROP TRIGGER IF EXISTS note_bodies_fts_update"),
+        QStringLiteral("DROP TABLE IF EXISTS notes_fts"),
+        QStringLiteral("DELETE FROM schema_backfill WHERE name = 'notes_fts'")});
+    if(!altered)
+        return false;
+
+    if(!execSchemaStatements({QStringLiteral("CREATE VIRTUAL TABLE notes_fts USING fts5("
+                                             "content, content = '', prefix = '2 3')")})){
+        qWarning() << "DBManager::compressNoteBodies: FTS5 is not available, "
+                      "search falls back to scanning the notes";
+        return true;
+    }
+
+    return execSchemaStatements({
+        QStringLiteral("INSERT INTO schema_backfill (name, next_id, end_id) "
+                       "SELECT 'notes_fts', (SELECT MIN(note_id) FROM note_bodies), (SELECT MAX(note_id) FROM note_bodies) "
+                       "WHERE EXISTS (SELECT 1 FROM note_bodies)")});
+}
+
+/*!
+ * \brief DBManager::runBackfillBatch
+ * Process the next batch of the first pending backfill, in its own transaction,
+ * then give the other requests a chance to run before the next batch.
+ * The position of each backfill is stored in schema_backfill,
+ * so a backfill interrupted by quitting resumes on the next start
+ */
+void DBManager::runBackfillBatch()
+{
+    QSqlQuery query;
+    query.exec(QStringLiteral("SELECT name, next_id, end_id FROM schema_backfill LIMIT 1"));
+    if(!query.next()){
+        updateFullTextSearchAvailability();
+        return;
+    }
+
+    QString name = query.value(0).toString();
+    qint64 nextId = query.value(1).toLongLong();
+    qint64 endId = query.value(2).toLongLong();
+    query.finish();
+
+    // last id of this batch
+    query.prepare(QStringLiteral("SELECT MAX(id) FROM (SELECT id FROM active_notes "
+                                 "WHERE id BETWEEN :next AND :end ORDER BY id LIMIT :limit)"));
+    query.bindValue(QStringLiteral(":next"), nextId);
+    query.bindValue(QStringLiteral(":end"), endId);
+    query.bindValue(QStringLiteral(":limit"), BACKFILL_BATCH_SIZE);
+    query.exec();
+    qint64 batchEndId = (query.next() && !query.value(0).isNull()) ? query.value(0).toLongLong() : endId;
+    query.finish();
+
+    QSqlDatabase::database().transaction();
+
+    bool done = backfill(name, nextId, batchEndId);
+    if(done){
+        query.prepare(batchEndId >= endId ? QStringLiteral("DELETE FROM schema_backfill WHERE name = :name")
+                                          : QStringLiteral("UPDATE schema_backfill SET next_id = :next "
+                                                           "WHERE name = :name"));
+        query.bindValue(QStringLiteral(":name"), name);
+        if(batchEndId < endId)
+            query.bindValue(QStringLiteral(":next"), batchEndId + 1);
+        done = query.exec();
+    }
+
+    if(done){
+        QSqlDatabase::database().commit();
+        updateFullTextSearchAvailability();
+        QTimer::singleShot(0, this, SLOT(runBackfillBatch()));
+    }else{
+        QSqlDatabase::database().rollback();
+        qWarning() << "DBManager::runBackfillBatch: backfill" << name << "failed, it will resume on next start";
+    }
+}
+
+/*!
+ * \brief DBManager::backfill
+ * Run the backfill 'name' on the notes whose id is between 'fromId' and 'toId'
+ * \param name
+ * \param fromId
+ * \param toId
+ * \return
+ */
+bool DBManager::backfill(const QString& name, qint64 fromId, qint64 toId)
+{
+    if(name == QStringLiteral("notes_fts"))
+        return backfillFullTextIndex(fromId, toId);
+
+    if(name == QStringLiteral("content_hash"))
+        return backfillContentHash(fromId, toId);
+
+    qWarning() << "DBManager::backfill: unknown backfill" << name;
+    return false;
+}
+
+/*!
+ * \brief DBManager::backfillFullTextIndex
+ * \param fromId
+ * \param toId
+ * \return
+ */
+bool DBManager::backfillFullTextIndex(qint64 fromId, qint64 toId)
+{
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(QStringLiteral("SELECT note_id, content, encoding FROM note_bodies "
+                                 "WHERE note_id BETWEEN :from AND :to"));
+    query.bindValue(QStringLiteral(":from"), fromId);
+    query.bindValue(QStringLiteral(":to"), toId);
+    if(!query.exec()){
+        qWarning() << "DBManager::backfill: " << query.lastError();
+        return false;
+    }
+
+    QSqlQuery& indexQuery = m_indexContentQuery;
+    while(query.next()){
+        indexQuery.bindValue(QStringLiteral(":id"), query.value(0));
+        indexQuery.bindValue(QStringLiteral(":content"), decodeNoteBody(query.value(1), query.value(2).toInt()));
+        if(!indexQuery.exec()){
+            qWarning() << "DBManager::backfill: " << indexQuery.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief DBManager::backfillContentHash
+ * \param fromId
+ * \param toId
+ * \return
+ */
+bool DBManager::backfillContentHash(qint64 fromId, qint64 toId)
+{
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    query.prepare(QStringLiteral("SELECT id, full_title, content, encoding "
+                                 "FROM active_notes JOIN note_bodies ON note_id = id "
+                                 "WHERE id BETWEEN :from AND :to"));
+    query.bindValue(QStringLiteral(":from"), fromId);
+    query.bindValue(QStringLiteral(":to"), toId);
+    if(!query.exec()){
+        qWarning() << "DBManager::backfill: " << query.lastError();
+        return false;
+    }
+
+    QSqlQuery hashQuery;
+    hashQuery.prepare(QStringLiteral("UPDATE active_notes SET content_hash = :hash WHERE id = :id"));
+    while(query.next()){
+        QString content = decodeNoteBody(query.value(2), query.value(3).toInt());
+        hashQuery.bindValue(QStringLiteral(":hash"), contentHash(query.value(1).toString(), content));
+        hashQuery.bindValue(QStringLiteral(":id"), query.value(0));
+        if(!hashQuery.exec()){
+            qWarning() << "DBManager::backfill: " << hashQuery.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief DBManager::updateFullTextSearchAvailability
+ * The full text index is only used once every note has been indexed,
+ * until then the notes the backfill hasn't reached are left out of it
+ */
+void DBManager::updateFullTextSearchAvailability()
+{
+    QSqlQuery query;
+    query.exec(QStringLiteral("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'notes_fts'"));
+    m_hasFullTextIndex = query.next();
+    query.finish();
+
+    query.exec(QStringLiteral("SELECT next_id, end_id FROM schema_backfill WHERE name = 'notes_fts'"));
+    bool isBackfilling = query.next();
+    m_fullTextBackfillNextId = isBackfilling ? query.value(0).toLongLong() : 1;
+    m_fullTextBackfillEndId = isBackfilling ? query.value(1).toLongLong() : 0;
+    query.finish();
+
+    m_isFullTextSearchAvailable = m_hasFullTextIndex && !isBackfilling;
+}
+
+/*!
+ * \brief DBManager::indexNoteContent
+ * Keep the contentless full text index in sync with a change of the content of a note.
+ * The words of 'oldContent' are removed from the index, the ones of 'newContent' added
+ * \param id
+ * \param oldContent the content the note was indexed with, null for a new note
+ * \param newContent the new content of the note, null for a removed note
+ * \return
+ */
+bool DBManager::indexNoteContent(int id, const QString* oldContent, const QString* newContent)
+{
+    if(!m_hasFullTextIndex || m_isBulkLoading
+            || (id >= m_fullTextBackfillNextId && id <= m_fullTextBackfillEndId))
+        return true;
+
+    if(oldContent != Q_NULLPTR){
+        QSqlQuery& query = m_unindexContentQuery;
+        query.bindValue(QStringLiteral(":id"), id);
+        query.bindValue(QStringLiteral(":content"), *oldContent);
+        if(!query.exec()){
+            qWarning () << __func__ << ": " << query.lastError();
+            return false;
+        }
+    }
+
+    if(newContent != Q_NULLPTR){
+        QSqlQuery& query = m_indexContentQuery;
+        query.bindValue(QStringLiteral(":id"), id);
+        query.bindValue(QStringLiteral(":content"), *newContent);
+        if(!query.exec()){
+            qWarning () << __func__ << ": " << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief DBManager::encodeNoteBody
+ * \param content
+ * \param encoding set to the BodyCompression used to encode 'content'
+ * \return 'content' as stored in note_bodies: plain text under the compression
+ * threshold or when compression doesn't make it smaller, compressed UTF-8 otherwise
+ */
+QVariant DBManager::encodeNoteBody(const QString& content, int* encoding) const
+{
+    *encoding = int(BodyCompression::None);
+    if(m_bodyCompression == BodyCompression::None || content.size() < BODY_COMPRESSION_THRESHOLD)
+        return content;
+
+    QByteArray utf8 = content.toUtf8();
+    QByteArray compressed;
+    BodyCompression compression = BodyCompression::Zlib;
+
+#ifdef NOTES_WITH_ZSTD
+    if(m_bodyCompression == BodyCompression::Zstd){
+        compressed.resize(int(ZSTD_compressBound(size_t(utf8.size()))));
+        size_t size = ZSTD_compress(compressed.data(), size_t(compressed.size()),
+                                    utf8.constData(), size_t(utf8.size()), ZSTD_COMPRESSION_LEVEL);
+        if(ZSTD_isError(size))
+            return content;
+
+        compressed.resize(int(size));
+        compression = BodyCompression::Zstd;
+    }
+#endif
+
+    if(compression == BodyCompression::Zlib)
+        compressed = qCompress(utf8);
+
+    if(compressed.size() >= utf8.size())
+        return content;
+
+    *encoding = int(compression);
+    return compressed;
+}
+
+/*!
+ * \brief DBManager::decodeNoteBody
+ * \param data
+ * \param encoding
+ * \return the text of a body read from note_bodies
+ */
+QString DBManager::decodeNoteBody(const QVariant& data, int encoding)
+{
+    switch(BodyCompression(encoding)){
+    case BodyCompression::None:
+        return data.toString();
+    case BodyCompression::Zlib:
+        return QString::fromUtf8(qUncompress(data.toByteArray()));
+    case BodyCompression::Zstd:
+#ifdef NOTES_WITH_ZSTD
+    {
+        QByteArray compressed = data.toByteArray();
+        unsigned long long size = ZSTD_getFrameContentSize(compressed.constData(), size_t(compressed.size()));
+        if(size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN || size > INT_MAX)
+            break;
+
+        QByteArray utf8(int(size), Qt::Uninitialized);
+        size_t decompressedSize = ZSTD_decompress(utf8.data(), size_t(utf8.size()),
+                                                  compressed.constData(), size_t(compressed.size()));
+        if(ZSTD_isError(decompressedSize))
+            break;
+
+        return QString::fromUtf8(utf8.constData(), int(decompressedSize));
+    }
+#else
+        qWarning() << "DBManager::decodeNoteBody: this build can't read zstd compressed notes";
+        return QString();
+#endif
+    }
+
+    qWarning() << "DBManager::decodeNoteBody: unreadable note body, encoding" << encoding;
+    return QString();
+}
+
+/*!
+ * \brief DBManager::readNoteBody
+ * \param id
+ * \param content set to the stored content of the note
+ * \return false if the note has no content stored
+ */
+bool DBManager::readNoteBody(int id, QString* content)
+{
+    QSqlQuery& query = m_getNoteContentQuery;
+    query.bindValue(QStringLiteral(":id"), id);
+    query.exec();
+    bool hasBody = query.next();
+    *content = hasBody ? decodeNoteBody(query.value(0), query.value(1).toInt()) : QString();
+    query.finish();
+
+    return hasBody;
+}
+
+/*!
+ * \brief DBManager::prepareQueries
+ * Prepare once every statement used by DBManager so that SQLite parses and plans
+ * them a single time for the whole life of the connection.
+ * Must be called on the database thread after the connection has been opened
+ */
+void DBManager::prepareQueries()
+{
+    auto prepare = [](QSqlQuery& query, const QString& queryStr){
+        query = QSqlQuery(QSqlDatabase::database());
+        if(!query.prepare(queryStr))
+            qWarning() << "DBManager::prepareQueries: " << query.lastError();
+    };
+
+    prepare(m_getLastRowIDQuery,
+            QStringLiteral("SELECT seq FROM SQLITE_SEQUENCE WHERE name = 'active_notes'"));
+
+    prepare(m_forceLastRowIndexQuery,
+            QStringLiteral("UPDATE SQLITE_SEQUENCE SET seq = :seq WHERE name = 'active_notes'"));
+
+    prepare(m_getNoteQuery,
+            QStringLiteral("SELECT id, creation_date, modification_date, content, full_title, encoding "
+                           "FROM active_notes LEFT JOIN note_bodies ON note_id = id WHERE id = :id LIMIT 1"));
+
+    prepare(m_getNoteContentQuery,
+            QStringLiteral("SELECT content, encoding FROM note_bodies WHERE note_id = :id"));
+
+    prepare(m_getContentHashQuery,
+            QStringLiteral("SELECT content_hash FROM active_notes WHERE id = :id"));
+
+    prepare(m_addNoteQuery,
+            QStringLiteral("INSERT INTO active_notes "
+                           "(creation_date, modification_date, deletion_date, full_title, content_hash) "
+                           "VALUES (:created, :modified, -1, :title, :hash)"));
+
+    prepare(m_addNoteBodyQuery,
+            QStringLiteral("INSERT INTO note_bodies (note_id, content, encoding) VALUES (:id, :content, :encoding)"));
+
+    prepare(m_updateNoteBodyQuery,
+            QStringLiteral("UPDATE note_bodies SET content = :content, encoding = :encoding WHERE note_id = :id"));
+
+    prepare(m_bulkAddNotesQuery, bulkInsertStatement(BULK_INSERT_ROWS, false));
+    prepare(m_bulkAddBodiesQuery, bulkInsertStatement(BULK_INSERT_ROWS, true));
+
+    QStringList hashPlaceholders;
+    for(int i = 0; i < BULK_INSERT_ROWS; ++i)
+        hashPlaceholders.append(QStringLiteral("?"));
+    prepare(m_findContentHashesQuery,
+            QStringLiteral("SELECT content_hash, id, creation_date, modification_date FROM active_notes "
+                           "WHERE content_hash IN (%1)").arg(hashPlaceholders.join(QLatin1Char(','))));
+
+    prepare(m_mergeNoteQuery,
+            QStringLiteral("UPDATE active_notes SET creation_date = MIN(creation_date, :created), "
+                           "modification_date = MAX(modification_date, :modified) WHERE id = :id"));
+
+    prepare(m_revisionChainQuery,
+            QStringLiteral("SELECT revision, is_snapshot, length(data) FROM note_revisions "
+                           "WHERE note_id = :id ORDER BY revision DESC"));
+
+    prepare(m_addRevisionQuery,
+            QStringLiteral("INSERT INTO note_revisions (note_id, revision, modification_date, is_snapshot, data) "
+                           "VALUES (:id, :revision, :date, :snapshot, :data)"));
+
+    prepare(m_getRevisionQuery,
+            QStringLiteral("SELECT is_snapshot, data FROM note_revisions "
+                           "WHERE note_id = :id AND revision <= :revision AND revision >= "
+                           "(SELECT MAX(revision) FROM note_revisions "
+                           "WHERE note_id = :snapshotNoteId AND revision <= :snapshotRevision AND is_snapshot = 1) "
+                           "ORDER BY revision"));
+
+    prepare(m_removeNoteQuery,
+            QStringLiteral("DELETE FROM active_notes WHERE id = :id"));
+
+    prepare(m_trashNoteQuery,
+            QStringLiteral("INSERT INTO deleted_notes "
+                           "VALUES (:id, :created, :modified, :deleted, :content, :title)"));
+
+    // UPSERT is only understood by SQLite 3.24.0 and later, older libraries fall back
+    // to an update followed, when no note has the id, by an insert with that id
+    QSqlQuery versionQuery(QStringLiteral("SELECT sqlite_version()"));
+    QStringList version = versionQuery.next() ? versionQuery.value(0).toString().split('.')
+                                              : QStringList();
+    m_isUpsertSupported = version.size() >= 2
+            && (version[0].toInt() > 3 || (version[0].toInt() == 3 && version[1].toInt() >= 24));
+
+    if(m_isUpsertSupported){
+        prepare(m_upsertNoteQuery,
+                QStringLiteral("INSERT INTO active_notes "
+                               "(id, creation_date, modification_date, deletion_date, full_title, content_hash) "
+                               "VALUES (:id, :created, :modified, -1, :title, :hash) "
+                               "ON CONFLICT(id) DO UPDATE SET "
+                               "modification_date = excluded.modification_date, "
+                               "full_title = excluded.full_title, "
+                               "content_hash = excluded.content_hash"));
+    }
+
+    prepare(m_insertNoteQuery,
+            QStringLiteral("INSERT INTO active_notes "
+                           "(id, creation_date, modification_date, deletion_date, full_title, content_hash) "
+                           "VALUES (:id, :created, :modified, -1, :title, :hash)"));
+
+    prepare(m_updateNoteQuery,
+            QStringLiteral("UPDATE active_notes SET modification_date = :date, "
+                           "full_title = :title, content_hash = :hash WHERE id = :id"));
+
+    prepare(m_purgeExpiredTrashQuery,
+            QStringLiteral("DELETE FROM deleted_notes WHERE id IN "
+                           "(SELECT id FROM deleted_notes WHERE deletion_date < :cutoff "
+                           "ORDER BY deletion_date LIMIT :batch)"));
+
+    prepare(m_purgeExcessTrashQuery,
+            QStringLiteral("DELETE FROM deleted_notes WHERE id IN "
+                           "(SELECT id FROM deleted_notes ORDER BY deletion_date DESC, id DESC "
+                           "LIMIT :batch OFFSET :keep)"));
+
+    prepare(m_migrateTrashQuery,
+            QStringLiteral("INSERT INTO deleted_notes "
+                           "VALUES (:id, :created, :modified, :deleted, :content, :title)"));
+
+    if(m_hasFullTextIndex){
+        prepare(m_indexContentQuery,
+                QStringLiteral("INSERT INTO notes_fts (rowid, content) VALUES (:id, :content)"));
+
+        prepare(m_unindexContentQuery,
+                QStringLiteral("INSERT INTO notes_fts (notes_fts, rowid, content) VALUES ('delete', :id, :content)"));
+    }
+}
+
+/*!
+ * \brief DBManager::getLastRowID
+ * \return
+ */
+int DBManager::getLastRowID()
+{
+    QSqlQuery& query = m_getLastRowIDQuery;
+    query.exec();
+    int lastRowID = query.next() ? query.value(0).toInt() : 0;
+    query.finish();
+    return lastRowID;
+}
+
+/*!
+ * \brief DBManager::forceLastRowIndexValue
+ * \param indexValue
+ * \return
+ */
+bool DBManager::forceLastRowIndexValue(const int indexValue)
+{
+    QSqlQuery& query = m_forceLastRowIndexQuery;
+    query.bindValue(QStringLiteral(":seq"), indexValue);
+    query.exec();
+    return query.numRowsAffected() == 1;
+}
+
+/*!
+ * \brief DBManager::getNote
+ * \param id
+ * \return
+ */
+NoteData* DBManager::getNote(QString id)
+{
+    QSqlQuery& query = m_getNoteQuery;
+
+    int parsedId = id.split('_')[1].toInt();
+    query.bindValue(QStringLiteral(":id"), parsedId);
+    query.exec();
+
+    NoteData* note = Q_NULLPTR;
+    if (query.first()) {
+        note = new NoteData(this->parent() == Q_NULLPTR ? Q_NULLPTR : this);
+        int id =  query.value(0).toInt();
+        QString content = decodeNoteBody(query.value(3), query.value(5).toInt());
+        QString fullTitle = query.value(4).toString();
+
+        note->setId(id);
+        note->setCreationDate(query.value(1).toLongLong());
+        note->setLastModificationDate(query.value(2).toLongLong());
+        note->setContent(content);
+        note->setFullTitle(fullTitle);
+    }
+    query.finish();
+
+    return note;
+}
+
+/*!
+ * \brief DBManager::getAllNotes
+ * \return
+ */
+QList<NoteData *> DBManager::getAllNotes()
+{
+    QList<NoteData *> noteList;
+
+    QSqlQuery query;
+    query.prepare("SELECT id, creation_date, modification_date, content, full_title, encoding "
+                  "FROM active_notes LEFT JOIN note_bodies ON note_id = id");
+    bool status = query.exec();
+    if(status){
+        while(query.next()){
+            NoteData* note = new NoteData(this);
+            int id =  query.value(0).toInt();
+            QString content = decodeNoteBody(query.value(3), query.value(5).toInt());
+            QString fullTitle = query.value(4).toString();
+
+            note->setId(id);
+            note->setCreationDate(query.value(1).toLongLong());
+            note->setLastModificationDate(query.value(2).toLongLong());
+            note->setContent(content);
+            note->setFullTitle(fullTitle);
+
+            noteList.push_back(note);
+        }
+    }
+
+    return noteList;
+}
+
+/*!
+ * \brief DBManager::getNoteContent
+ * \param id
+ * \return the content of the note, taken from the write-behind queue
+ * if a save of this note is still waiting
+ */
+QString DBManager::getNoteContent(int id)
+{
+    NoteData* pendingNote = m_pendingSaves.value(id, Q_NULLPTR);
+    if(pendingNote != Q_NULLPTR)
+        return pendingNote->content();
+
+    QString content;
+    readNoteBody(id, &content);
+    return content;
+}
+
+/*!
+ * \brief DBManager::addNote
+ * \param note
+ * \return
+ */
+bool DBManager::addNote(NoteData* note)
+{
+    QSqlQuery& query = m_addNoteQuery;
+
+    qint64 epochTimeDateCreated = note->creationDate();
+    qint64 epochTimeDateLastModified = note->lastModificationDate() == -1 ? epochTimeDateCreated
+                                                                          : note->lastModificationDate();
+
+    query.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+    query.bindValue(QStringLiteral(":modified"), epochTimeDateLastModified);
+    query.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+    query.bindValue(QStringLiteral(":hash"), noteContentHash(note));
+
+    if (!query.exec()) {
+        qWarning () << __func__ << ": " << query.lastError();
+        return false;
+    }
+
+    int id = query.lastInsertId().toInt();
+    QString content = stripNullChars(note->content());
+    int encoding;
+
+    QSqlQuery& bodyQuery = m_addNoteBodyQuery;
+    bodyQuery.bindValue(QStringLiteral(":id"), id);
+    bodyQuery.bindValue(QStringLiteral(":content"), encodeNoteBody(content, &encoding));
+    bodyQuery.bindValue(QStringLiteral(":encoding"), encoding);
+
+    if (!bodyQuery.exec()) {
+        qWarning () << __func__ << ": " << bodyQuery.lastError();
+    }
+    return (query.numRowsAffected() == 1 && bodyQuery.numRowsAffected() == 1
+            && indexNoteContent(id, Q_NULLPTR, &content));
+}
+
+/*!
+ * \brief DBManager::writeNoteBody
+ * Store the content of the note and record it as a new revision.
+ * With the content hash the note had before this save, an unchanged note
+ * isn't read at all, and the previous content of the last notes written
+ * is taken from m_writtenBodies instead of being read and decoded,
+ * as long as the stored hash says it is still the one in the database
+ * \param note
+ * \param storedHash the content hash of the stored note, null if unknown
+ * \return
+ */
+bool DBManager::writeNoteBody(NoteData* note, const qint64* storedHash)
+{
+    int id = note->id();
+    qint64 hash = noteContentHash(note);
+    if(storedHash != Q_NULLPTR && *storedHash == hash)
+        return true;
+
+    QString content = stripNullChars(note->content());
+
+    QString previousContent;
+    bool hasBody;
+    auto written = m_writtenBodies.constFind(id);
+    if(storedHash != Q_NULLPTR && written != m_writtenBodies.constEnd() && written->contentHash == *storedHash){
+        previousContent = written->content;
+        hasBody = true;
+    }else{
+        hasBody = readNoteBody(id, &previousContent);
+    }
+
+    if(hasBody && previousContent == content)
+        return true;
+
+    int encoding;
+    QSqlQuery& query = hasBody ? m_updateNoteBodyQuery : m_addNoteBodyQuery;
+    query.bindValue(QStringLiteral(":id"), id);
+    query.bindValue(QStringLiteral(":content"), encodeNoteBody(content, &encoding));
+    query.bindValue(QStringLiteral(":encoding"), encoding);
+    if (!query.exec()) {
+        qWarning () << __func__ << ": " << query.lastError();
+    }
+    if (query.numRowsAffected() != 1)
+        return false;
+
+    if(!indexNoteContent(id, hasBody ? &previousContent : Q_NULLPTR, &content))
+        return false;
+
+    qint64 modificationDate = note->lastModificationDate();
+    if(!recordRevision(id, hasBody ? &previousContent : Q_NULLPTR, content, modificationDate))
+        return false;
+
+    // a rolled back write leaves another hash stored, the entry is then ignored
+    if(m_writtenBodies.size() >= WRITTEN_BODIES_MAX && !m_writtenBodies.contains(id))
+        m_writtenBodies.clear();
+    WrittenBody body = {hash, content};
+    m_writtenBodies.insert(id, body);
+    return true;
+}
+
+/*!
+ * \brief DBManager::recordRevision
+ * Append 'content' to the revisions of the note, as a delta from 'previousContent'.
+ * A compressed snapshot of the whole content is stored instead once the deltas
+ * since the last snapshot take more bytes than that snapshot, or get too many
+ * to replay quickly,
+ * so rebuilding a revision reads one snapshot and a bounded number of deltas
+ * \param noteId
+ * \param previousContent the content being replaced, null for a new note
+ * \param content
+ * \param modificationDate
+ * \return
+ */
+bool DBManager::recordRevision(int noteId, const QString* previousContent, const QString& content,
+                               qint64 modificationDate)
+{
+    QSqlQuery& chainQuery = m_revisionChainQuery;
+    chainQuery.setForwardOnly(true);
+    chainQuery.bindValue(QStringLiteral(":id"), noteId);
+    chainQuery.exec();
+
+    int lastRevision = -1;
+    int chainLength = 0;
+    qint64 chainSize = 0;
+    qint64 snapshotSize = 0;
+    bool hasSnapshot = false;
+    while(!hasSnapshot && chainLength < MAX_REVISION_DELTA_CHAIN && chainQuery.next()){
+        if(lastRevision == -1)
+            lastRevision = chainQuery.value(0).toInt();
+        hasSnapshot = chainQuery.value(1).toBool();
+        if(hasSnapshot){
+            snapshotSize = chainQuery.value(2).toLongLong();
+        }else{
+            ++chainLength;
+            chainSize += chainQuery.value(2).toLongLong();
+        }
+    }
+    chainQuery.finish();
+
+    QSqlQuery& addQuery = m_addRevisionQuery;
+    auto addRevision = [&](bool isSnapshot, const QByteArray& data){
+        addQuery.bindValue(QStringLiteral(":id"), noteId);
+        addQuery.bindValue(QStringLiteral(":revision"), ++lastRevision);
+        addQuery.bindValue(QStringLiteral(":date"), modificationDate);
+        addQuery.bindValue(QStringLiteral(":snapshot"), isSnapshot);
+        addQuery.bindValue(QStringLiteral(":data"), data);
+        if(!addQuery.exec()){
+            qWarning () << "DBManager::recordRevision: " << addQuery.lastError();
+            return false;
+        }
+        return true;
+    };
+
+    // the history of notes saved before revisions were kept starts with the content they had
+    if(previousContent != Q_NULLPTR && lastRevision == -1){
+        QByteArray snapshot = qCompress(previousContent->toUtf8());
+        if(!addRevision(true, snapshot))
+            return false;
+        hasSnapshot = true;
+        snapshotSize = snapshot.size();
+    }
+
+    // the last snapshot stands for the size a new one would have, both are compressed bytes
+    if(previousContent != Q_NULLPTR && hasSnapshot && chainLength < MAX_REVISION_DELTA_CHAIN){
+        QByteArray delta = NoteDelta::encode(*previousContent, content);
+        if(chainSize + delta.size() < snapshotSize)
+            return addRevision(false, delta);
+    }
+
+    return addRevision(true, qCompress(content.toUtf8()));
+}
+
+/*!
+ * \brief DBManager::getNoteRevision
+ * \param noteId
+ * \param revision
+ * \return the content of the note as it was saved in 'revision'
+ */
+QString DBManager::getNoteRevision(int noteId, int revision)
+{
+    QSqlQuery& query = m_getRevisionQuery;
+    query.setForwardOnly(true);
+    query.bindValue(QStringLiteral(":id"), noteId);
+    query.bindValue(QStringLiteral(":revision"), revision);
+    query.bindValue(QStringLiteral(":snapshotNoteId"), noteId);
+    query.bindValue(QStringLiteral(":snapshotRevision"), revision);
+    query.exec();
+
+    QString content;
+    bool ok = true;
+    while(ok && query.next()){
+        QByteArray data = query.value(1).toByteArray();
+        if(query.value(0).toBool())
+            content = QString::fromUtf8(qUncompress(data));
+        else
+            content = NoteDelta::apply(content, data, &ok);
+    }
+    query.finish();
+
+    if(!ok)
+        qWarning() << "DBManager::getNoteRevision: revision" << revision << "of note" << noteId << "is corrupted";
+
+    return content;
+}
+
+/*!
+ * \brief DBManager::removeNote
+ * \param note
+ * \return
+ */
+bool DBManager::removeNote(NoteData* note)
+{
+    QSqlQuery& removeQuery = m_removeNoteQuery;
+
+    int id = note->id();
+
+    // the index has to be given the words it holds for the note, the ones stored
+    QString storedContent;
+    if(readNoteBody(id, &storedContent))
+        indexNoteContent(id, &storedContent, Q_NULLPTR);
+
+    removeQuery.bindValue(QStringLiteral(":id"), id);
+    removeQuery.exec();
+    bool removed = (removeQuery.numRowsAffected() == 1);
+
+    QSqlQuery& trashQuery = m_trashNoteQuery;
+
+    qint64 epochTimeDateCreated = note->creationDate();
+    qint64 epochTimeDateModified = note->lastModificationDate();
+    qint64 epochTimeDateDeleted = note->deletionDate();
+
+    trashQuery.bindValue(QStringLiteral(":id"), id);
+    trashQuery.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+    trashQuery.bindValue(QStringLiteral(":modified"), epochTimeDateModified);
+    trashQuery.bindValue(QStringLiteral(":deleted"), epochTimeDateDeleted);
+    trashQuery.bindValue(QStringLiteral(":content"), stripNullChars(note->content()));
+    trashQuery.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+
+    if (!trashQuery.exec()) {
+        qWarning () << __func__ << ": " << trashQuery.lastError();
+    }
+    bool addedToTrashDB = (trashQuery.numRowsAffected() == 1);
+
+    return (removed && addedToTrashDB);
+}
+
+/*!
+ * \brief DBManager::permanantlyRemoveAllNotes
+ * \return
+ */
+bool DBManager::permanantlyRemoveAllNotes()
+{
+    QSqlQuery query;
+    if(m_hasFullTextIndex)
+        query.exec(QStringLiteral("INSERT INTO notes_fts (notes_fts) VALUES ('delete-all')"));
+
+    return query.exec(QString("DELETE FROM active_notes"));
+}
+
+/*!
+ * \brief DBManager::updateNote
+ * \param note
+ * \return
+ */
+bool DBManager::updateNote(NoteData* note)
+{
+    QSqlQuery& query = m_updateNoteQuery;
+
+    int id = note->id();
+    qint64 epochTimeDateModified = note->lastModificationDate();
+
+    query.bindValue(QStringLiteral(":date"), epochTimeDateModified);
+    query.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+    query.bindValue(QStringLiteral(":hash"), noteContentHash(note));
+    query.bindValue(QStringLiteral(":id"), id);
+
+    if (!query.exec()) {
+        qWarning () << __func__ << ": " << query.lastError();
+    }
+    if (query.numRowsAffected() != 1)
+        return false;
+
+    return writeNoteBody(note);
+}
+
+/*!
+ * \brief DBManager::upsertNote
+ * Insert the note, or update it if a note with the same id is already stored.
+ * The row and the body are written under a savepoint, if one of them fails
+ * neither is kept and the note stays as it was
+ * \param note
+ * \return the number of rows written, 0 if the note wasn't saved
+ */
+int DBManager::upsertNote(NoteData* note)
+{
+    QSqlQuery savepoint;
+    if(!savepoint.exec(QStringLiteral("SAVEPOINT upsert_note"))){
+        qWarning () << __func__ << ": " << savepoint.lastError();
+        return 0;
+    }
+
+    int rowsAffected = writeNote(note);
+    if(rowsAffected == 0)
+        savepoint.exec(QStringLiteral("ROLLBACK TO upsert_note"));
+    savepoint.exec(QStringLiteral("RELEASE upsert_note"));
+
+    return rowsAffected;
+}
+
+/*!
+ * \brief DBManager::writeNote
+ * Write the row of the note in a single statement keyed on the primary key, then its body
+ * \param note
+ * \return the number of rows written, 0 if one of the writes failed
+ */
+int DBManager::writeNote(NoteData* note)
+{
+    qint64 epochTimeDateCreated = note->creationDate();
+    qint64 epochTimeDateModified = note->lastModificationDate() == -1 ? epochTimeDateCreated
+                                                                      : note->lastModificationDate();
+
+    // the hash the row is about to lose tells writeNoteBody what the stored body is
+    QSqlQuery& hashQuery = m_getContentHashQuery;
+    hashQuery.bindValue(QStringLiteral(":id"), note->id());
+    bool hasStoredHash = hashQuery.exec() && hashQuery.next() && !hashQuery.value(0).isNull();
+    qint64 storedHash = hasStoredHash ? hashQuery.value(0).toLongLong() : 0;
+    hashQuery.finish();
+
+    if(!m_isUpsertSupported){
+        // the note keeps its id either way, the model, the journal and the revisions refer to it
+        QSqlQuery& updateQuery = m_updateNoteQuery;
+        updateQuery.bindValue(QStringLiteral(":date"), epochTimeDateModified);
+        updateQuery.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+        updateQuery.bindValue(QStringLiteral(":hash"), noteContentHash(note));
+        updateQuery.bindValue(QStringLiteral(":id"), note->id());
+        if (!updateQuery.exec()) {
+            qWarning () << __func__ << ": " << updateQuery.lastError();
+            return 0;
+        }
+
+        if(updateQuery.numRowsAffected() == 0){
+            QSqlQuery& insertQuery = m_insertNoteQuery;
+            insertQuery.bindValue(QStringLiteral(":id"), note->id());
+            insertQuery.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+            insertQuery.bindValue(QStringLiteral(":modified"), epochTimeDateModified);
+            insertQuery.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+            insertQuery.bindValue(QStringLiteral(":hash"), noteContentHash(note));
+            if (!insertQuery.exec()) {
+                qWarning () << __func__ << ": " << insertQuery.lastError();
+                return 0;
+            }
+        }
+
+        return writeNoteBody(note, hasStoredHash ? &storedHash : Q_NULLPTR) ? 1 : 0;
+    }
+
+    QSqlQuery& query = m_upsertNoteQuery;
+
+    query.bindValue(QStringLiteral(":id"), note->id());
+    query.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+    query.bindValue(QStringLiteral(":modified"), epochTimeDateModified);
+    query.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
+    query.bindValue(QStringLiteral(":hash"), noteContentHash(note));
+
+    if (!query.exec()) {
+        qWarning () << __func__ << ": " << query.lastError();
+        return 0;
+    }
+    int rowsAffected = query.numRowsAffected();
+
+    return writeNoteBody(note, hasStoredHash ? &storedHash : Q_NULLPTR) ? rowsAffected : 0;
+}
+
+/*!
+ * \brief DBManager::flushPendingSaves
+ * Write every queued note snapshot in one transaction and
+ * notify which notes are now committed to the database.
+ * The snapshots that couldn't be saved, all of them if the commit fails,
+ * stay queued and are retried after SAVE_RETRY_DELAY ms
+ */
+void DBManager::flushPendingSaves()
+{
+    m_writeBehindTimer->stop();
+    m_saveRetryTimer->stop();
+
+    if(m_pendingSaves.isEmpty())
+        return;
+
+    QList<NoteData*> savedList;
+    savedList.reserve(m_pendingSaves.size());
+
+    QSqlDatabase database = QSqlDatabase::database();
+    if(database.transaction()){
+        for(NoteData* note : m_pendingSaves){
+            if(upsertNote(note) == 1)
+                savedList.append(note);
+        }
+
+        if(!database.commit()){
+            qWarning() << "DBManager::flushPendingSaves: " << database.lastError();
+            database.rollback();
+            savedList.clear();
+        }
+    }else{
+        qWarning() << "DBManager::flushPendingSaves: " << database.lastError();
+    }
+
+    QList<int> savedIdList;
+    QList<qint64> savedDateList;
+    savedIdList.reserve(savedList.size());
+    savedDateList.reserve(savedList.size());
+    for(NoteData* note : savedList){
+        savedIdList.append(note->id());
+        savedDateList.append(note->lastModificationDate());
+        m_pendingSaves.remove(note->id());
+        delete note;
+    }
+
+    if(!m_pendingSaves.isEmpty()){
+        emit notesSaveFailed(m_pendingSaves.keys());
+        m_saveRetryTimer->start();
+    }
+
+    emit notesSaved(savedIdList, savedDateList);
 }
 
 /*!
- * \brief DBManager::createTables
+ * \brief toFullTextQuery
+ * Turn what the user typed into an FTS5 query.
+ * Every word is matched as a prefix, text between double quotes is matched
+ * as a phrase and AND, OR, NOT are kept as operators
+ * \param keyword
+ * \return
  */
-void DBManager::createTables()
+static QString toFullTextQuery(const QString& keyword)
 {
-    QSqlQuery query;
-    QString active = "CREATE TABLE active_notes ("
-                     "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                     "creation_date INTEGER NOT NULL DEFAULT (0),"
-                     "modification_date INTEGER NOT NULL DEFAULT (0),"
-                     "deletion_date INTEGER NOT NULL DEFAULT (0),"
-                     "content TEXT, "
-                     "full_title TEXT);";
-
-    query.exec(active);
+    static const QStringList operators = {QStringLiteral("AND"), QStringLiteral("OR"), QStringLiteral("NOT")};
+
+    QStringList terms;
+    QString term;
+    bool inPhrase = false;
+
+    auto appendTerm = [&](bool isPrefix){
+        if(term.isEmpty())
+            return;
+
+        if(!inPhrase && operators.contains(term)){
+            // an operator needs a term on each side
+            if(!terms.isEmpty() && !operators.contains(terms.last()))
+                terms.append(term);
+        }else{
+            QString quoted = QStringLiteral("\"") + term + QStringLiteral("\"");
+            terms.append(isPrefix ? quoted + QStringLiteral("*") : quoted);
+        }
+        term.clear();
+    };
+
+    for(const QChar& c : keyword){
+        if(c == QLatin1Char('"')){
+            appendTerm(!inPhrase);
+            inPhrase = !inPhrase;
+        }else if(c.isSpace() && !inPhrase){
+            appendTerm(true);
+        }else{
+            term.append(c);
+        }
+    }
+    // an unterminated phrase is still being typed
+    appendTerm(true);
 
-    QString active_index = "CREATE UNIQUE INDEX active_index on active_notes (id ASC);";
-    query.exec(active_index);
+    while(!terms.isEmpty() && operators.contains(terms.last()))
+        terms.removeLast();
 
-    QString deleted = "CREATE TABLE deleted_notes ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
-                      "creation_date INTEGER NOT NULL DEFAULT (0),"
-                      "modification_date INTEGER NOT NULL DEFAULT (0),"
-                      "deletion_date INTEGER NOT NULL DEFAULT (0),"
-                      "content TEXT,"
-                      "full_title TEXT)";
-    query.exec(deleted);
+    return terms.join(QLatin1Char(' '));
 }
 
 /*!
- * \brief DBManager::getLastRowID
- * \return
+ * \brief DBManager::searchNotes
+ * \param keyword
+ * \return the ids of the notes matching 'keyword', best match first
  */
-int DBManager::getLastRowID()
+QList<int> DBManager::searchNotes(const QString& keyword)
 {
-    QSqlQuery query;
-    query.exec("SELECT seq from SQLITE_SEQUENCE WHERE name='active_notes';");
-    query.next();
-    return query.value(0).toInt();
+    return searchNotes(QSqlDatabase::database(), keyword, m_isFullTextSearchAvailable);
 }
 
 /*!
- * \brief DBManager::forceLastRowIndexValue
- * \param indexValue
- * \return
+ * \brief DBManager::searchNotes
+ * Can be run on any thread, with the connection of that thread
+ * \param database
+ * \param keyword
+ * \param isFullTextSearchAvailable
+ * \return the ids of the notes matching 'keyword', best match first
  */
-bool DBManager::forceLastRowIndexValue(const int indexValue)
+QList<int> DBManager::searchNotes(const QSqlDatabase& database, const QString& keyword, bool isFullTextSearchAvailable)
 {
-    QSqlQuery query;
-    QString queryStr = QStringLiteral("UPDATE SQLITE_SEQUENCE "
-                                      "SET seq=%1 "
-                                      "WHERE name='active_notes';").arg(indexValue);
-    query.exec(queryStr);
-    return query.numRowsAffected() == 1;
+    QList<int> noteIdList;
+
+    QString query = isFullTextSearchAvailable ? toFullTextQuery(keyword) : keyword.toCaseFolded();
+    if(query.isEmpty())
+        return noteIdList;
+
+    QSqlQuery searchQuery(database);
+    searchQuery.setForwardOnly(true);
+    if(isFullTextSearchAvailable){
+        searchQuery.prepare(QStringLiteral("SELECT rowid FROM notes_fts WHERE notes_fts MATCH :query ORDER BY rank"));
+        searchQuery.bindValue(QStringLiteral(":query"), query);
+    }else{
+        // SQLite's lower() only folds ASCII, the bodies are matched here instead
+        searchQuery.prepare(QStringLiteral("SELECT id, content, encoding FROM active_notes JOIN note_bodies ON note_id = id "
+                                           "ORDER BY modification_date DESC"));
+    }
+
+    if(!searchQuery.exec()){
+        qWarning () << __func__ << ": " << searchQuery.lastError();
+        return noteIdList;
+    }
+
+    while(searchQuery.next()){
+        if(!isFullTextSearchAvailable
+                && !decodeNoteBody(searchQuery.value(1), searchQuery.value(2).toInt()).toCaseFolded().contains(query))
+            continue;
+
+        noteIdList.append(searchQuery.value(0).toInt());
+    }
+    searchQuery.finish();
+
+    return noteIdList;
 }
 
 /*!
- * \brief DBManager::getNote
- * \param id
+ * \brief DBManager::migrateTrash
+ * \param note
  * \return
  */
-NoteData* DBManager::getNote(QString id)
+bool DBManager::migrateTrash(NoteData* note)
 {
-    QSqlQuery query;
+    QSqlQuery& query = m_migrateTrashQuery;
 
-    int parsedId = id.split('_')[1].toInt();
-    QString queryStr = QStringLiteral("SELECT * FROM active_notes WHERE id = %1 LIMIT 1").arg(parsedId);
-    query.exec(queryStr);
+    int id = note->id();
+    qint64 epochTimeDateCreated = note->creationDate();
+    qint64 epochTimeDateModified = note->lastModificationDate();
+    qint64 epochTimeDateDeleted = note->deletionDate();
 
-    if (query.first()) {
-        NoteData* note = new NoteData(this->parent() == Q_NULLPTR ? Q_NULLPTR : this);
-        int id =  query.value(0).toInt();
-        qint64 epochDateTimeCreation = query.value(1).toLongLong();
-        QDateTime dateTimeCreation = QDateTime::fromMSecsSinceEpoch(epochDateTimeCreation);
-        qint64 epochDateTimeModification= query.value(2).toLongLong();
-        QDateTime dateTimeModification = QDateTime::fromMSecsSinceEpoch(epochDateTimeModification);
-        QString content = query.value(4).toString();
-        QString fullTitle = query.value(5).toString();
+    query.bindValue(QStringLiteral(":id"), id);
+    query.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+    query.bindValue(QStringLiteral(":modified"), epochTimeDateModified);
+    query.bindValue(QStringLiteral(":deleted"), epochTimeDateDeleted);
+    query.bindValue(QStringLiteral(":content"), stripNullChars(note->content()));
+    query.bindValue(QStringLiteral(":title"), stripNullChars(note->fullTitle()));
 
-        note->setId(id);
-        note->setCreationDateTime(dateTimeCreation);
-        note->setLastModificationDateTime(dateTimeModification);
-        note->setContent(content);
-        note->setFullTitle(fullTitle);
-        return note;
+    if (!query.exec()) {
+        qWarning () << __func__ << ": " << query.lastError();
     }
-    return Q_NULLPTR;
+    return (query.numRowsAffected() == 1);
 }
 
 /*!
- * \brief DBManager::isNoteExist
- * \param note
- * \return
+ * \brief DBManager::onNotesListRequested
+ * Stream the notes, without their content, most recently modified first.
+ * They are read on a reader thread and sent in pages so the list can show
+ * the first notes before the whole table has been read
  */
-bool DBManager::isNoteExist(NoteData* note)
+void DBManager::onNotesListRequested()
 {
-    QSqlQuery query;
-
-    int id = note->id();
-    QString queryStr = QStringLiteral("SELECT EXISTS(SELECT 1 FROM active_notes WHERE id = %1 LIMIT 1 )")
-            .arg(id);
-    query.exec(queryStr);
-    query.next();
+    flushPendingSaves();
 
-    return query.value(0).toInt() == 1;
+    int noteCounter = getLastRowID();
+    runOnReader([this, noteCounter](){readNotesList(noteCounter);});
 }
 
 /*!
- * \brief DBManager::getAllNotes
- * \return
+ * \brief DBManager::readNotesList
+ * The notes are handed to the application thread, which owns them from then on.
+ * Two lists are never read at the same time, so their pages can't interleave
+ * \param noteCounter
  */
-QList<NoteData *> DBManager::getAllNotes()
+void DBManager::readNotesList(int noteCounter)
 {
+    QMutexLocker locker(&m_notesListMutex);
+    QThread* applicationThread = QCoreApplication::instance()->thread();
+
     QList<NoteData *> noteList;
+    noteList.reserve(NOTES_PAGE_SIZE);
 
-    QSqlQuery query;
-    query.prepare("SELECT * FROM active_notes");
-    bool status = query.exec();
+    QSqlQuery query(readerConnection());
+    query.setForwardOnly(true);
+    bool status = query.exec(QStringLiteral("SELECT id, creation_date, modification_date, full_title "
+                                            "FROM active_notes ORDER BY modification_date DESC"));
     if(status){
         while(query.next()){
-            NoteData* note = new NoteData(this);
-            int id =  query.value(0).toInt();
-            qint64 epochDateTimeCreation = query.value(1).toLongLong();
-            QDateTime dateTimeCreation = QDateTime::fromMSecsSinceEpoch(epochDateTimeCreation);
-            qint64 epochDateTimeModification= query.value(2).toLongLong();
-            QDateTime dateTimeModification = QDateTime::fromMSecsSinceEpoch(epochDateTimeModification);
-            QString content = query.value(4).toString();
-            QString fullTitle = query.value(5).toString();
-
-            note->setId(id);
-            note->setCreationDateTime(dateTimeCreation);
-            note->setLastModificationDateTime(dateTimeModification);
-            note->setContent(content);
-            note->setFullTitle(fullTitle);
+            NoteData* note = new NoteData();
+            note->setId(query.value(0).toInt());
+            note->setCreationDate(query.value(1).toLongLong());
+            note->setLastModificationDate(query.value(2).toLongLong());
+            note->setFullTitle(query.value(3).toString());
+            note->setContentLoaded(false);
+            note->moveToThread(applicationThread);
 
             noteList.push_back(note);
+
+            if(noteList.size() == NOTES_PAGE_SIZE){
+                emit notesReceived(noteList, noteCounter, false);
+                noteList.clear();
+                noteList.reserve(NOTES_PAGE_SIZE);
+            }
         }
     }
 
-    return noteList;
+    emit notesReceived(noteList, noteCounter, true);
 }
 
 /*!
- * \brief DBManager::addNote
+ * \brief DBManager::onOpenDBManagerRequested
+ * \param path
+ */
+void DBManager::onOpenDBManagerRequested(QString path)
+{
+    open(path);
+}
+
+/*!
+ * \brief DBManager::onCreateUpdateRequested
+ * Queue a snapshot of the note to be written by the write-behind queue.
+ * DBManager takes ownership of the snapshot, a newer snapshot of the same note
+ * replaces the one still waiting so repeated saves collapse into a single write
  * \param note
- * \return
  */
-bool DBManager::addNote(NoteData* note)
+void DBManager::onCreateUpdateRequested(NoteData* note)
 {
-    QSqlQuery query;
-    QString emptyStr;
-
-    qint64 epochTimeDateCreated = note->creationDateTime()
-            .toMSecsSinceEpoch();
-    QString content = note->content()
-                            .replace("'","''")
-                            .replace(QChar('\x0'), emptyStr);
-    QString fullTitle = note->fullTitle()
-                              .replace("'","''")
-                              .replace(QChar('\x0'), emptyStr);
-
-    qint64 epochTimeDateLastModified = note->lastModificationdateTime().isNull() ? epochTimeDateCreated
-                                                                                 : note->lastModificationdateTime().toMSecsSinceEpoch();
-
-    QString queryStr = QString("INSERT INTO active_notes "
-                               "(creation_date, modification_date, deletion_date, content, full_title) "
-                               "VALUES (%1, %2, -1, '%3', '%4');")
-                               .arg(epochTimeDateCreated)
-                               .arg(epochTimeDateLastModified)
-                               .arg(content)
-                               .arg(fullTitle);
-
-    query.exec(queryStr);
+    NoteData* pendingNote = m_pendingSaves.value(note->id(), Q_NULLPTR);
+    if(pendingNote != note)
+        delete pendingNote;
 
-    return (query.numRowsAffected() == 1);
+    m_pendingSaves.insert(note->id(), note);
+
+    if(!m_writeBehindTimer->isActive())
+        m_writeBehindTimer->start();
 }
 
 /*!
- * \brief DBManager::removeNote
- * \param note
+ * \brief DBManager::onFlushRequested
+ * Barrier that returns once every queued save is committed
+ */
+void DBManager::onFlushRequested()
+{
+    flushPendingSaves();
+}
+
+/*!
+ * \brief DBManager::onNoteRevisionRequested
+ * \param id
+ * \param revision
  * \return
  */
-bool DBManager::removeNote(NoteData* note)
+QString DBManager::onNoteRevisionRequested(int id, int revision)
 {
-    QSqlQuery query;
-    QString emptyStr;
+    flushPendingSaves();
+    return getNoteRevision(id, revision);
+}
 
-    int id = note->id();
-    QString queryStr = QStringLiteral("DELETE FROM active_notes "
-                                      "WHERE id=%1").arg(id);
-    query.exec(queryStr);
-    bool removed = (query.numRowsAffected() == 1);
-
-    qint64 epochTimeDateCreated = note->creationDateTime().toMSecsSinceEpoch();
-    qint64 epochTimeDateModified = note->lastModificationdateTime().toMSecsSinceEpoch();
-    qint64 epochTimeDateDeleted = note->deletionDateTime().toMSecsSinceEpoch();
-    QString content = note->content()
-                            .replace("'","''")
-                            .replace(QChar('\x0'), emptyStr);
-    QString fullTitle = note->fullTitle()
-                              .replace("'","''")
-                              .replace(QChar('\x0'), emptyStr);
-
-    queryStr = QString("INSERT INTO deleted_notes "
-                       "VALUES (%1, %2, %3, %4, '%5', '%6');")
-                       .arg(id)
-                       .arg(epochTimeDateCreated)
-                       .arg(epochTimeDateModified)
-                       .arg(epochTimeDateDeleted)
-                       .arg(content)
-                       .arg(fullTitle);
-
-    query.exec(queryStr);
-    bool addedToTrashDB = (query.numRowsAffected() == 1);
+/*!
+ * \brief DBManager::onSearchRequested
+ * Commit the queued saves, then search on a reader thread.
+ * The result is sent with searchFinished
+ * \param keyword
+ */
+void DBManager::onSearchRequested(QString keyword)
+{
+    flushPendingSaves();
 
-    return (removed && addedToTrashDB);
+    bool isFullTextSearchAvailable = m_isFullTextSearchAvailable;
+    runOnReader([this, keyword, isFullTextSearchAvailable](){
+        emit searchFinished(keyword, searchNotes(readerConnection(), keyword, isFullTextSearchAvailable));
+    });
 }
 
 /*!
- * \brief DBManager::permanantlyRemoveAllNotes
+ * \brief DBManager::onDeleteNoteRequested
+ * \param note owned by the database manager from now on
+ */
+void DBManager::onDeleteNoteRequested(NoteData* note)
+{
+    // the note goes to the trash with its latest content,
+    // a save still waiting for it would bring it back to life
+    delete m_pendingSaves.take(note->id());
+
+    removeNote(note);
+    delete note;
+}
+
+/*!
+ * \brief DBManager::onImportNotesRequested
+ * \param noteList
+ */
+void DBManager::onImportNotesRequested(QList<NoteData *> noteList) {
+    flushPendingSaves();
+
+    QSqlDatabase::database().transaction();
+    beginBulkLoad(true, noteList.size());
+    bool loaded = bulkAddNotes(noteList, false);
+    if(endBulkLoad(loaded)){
+        QSqlDatabase::database().commit();
+        emitImportedNotes();
+        emit importFinished(m_bulkNotesInserted, m_bulkNotesSkipped, m_bulkNotesMerged);
+    }else{
+        QSqlDatabase::database().rollback();
+    }
+}
+
+/*!
+ * \brief DBManager::bulkInsertStatement
+ * \param rowCount
+ * \param isBody
+ * \return an insert of 'rowCount' notes, or of their bodies, in a single statement
+ */
+QString DBManager::bulkInsertStatement(int rowCount, bool isBody)
+{
+    QString statement = isBody ? QStringLiteral("INSERT INTO note_bodies (note_id, content, encoding) VALUES ")
+                               : QStringLiteral("INSERT INTO active_notes "
+                                                "(id, creation_date, modification_date, deletion_date, full_title, content_hash) VALUES ");
+    QString row = isBody ? QStringLiteral("(?, ?, ?)") : QStringLiteral("(?, ?, ?, -1, ?, ?)");
+
+    statement.reserve(statement.size() + rowCount * (row.size() + 1));
+    for(int i = 0; i < rowCount; ++i){
+        if(i > 0)
+            statement += QLatin1Char(',');
+        statement += row;
+    }
+    return statement;
+}
+
+/*!
+ * \brief DBManager::beginBulkLoad
+ * Prepare the database, inside the current transaction, for a large number of new notes.
+ * The full text index is left alone during the load and brought up to date once by endBulkLoad.
+ * The modification date index is dropped and rebuilt by endBulkLoad too, but only for
+ * at least IMPORT_BATCH_SIZE notes and a 1/INDEX_REBUILD_MIN_FRACTION of the stored ones,
+ * smaller loads update it as they go for less than a rebuild costs
+ * \param deduplicate skip the notes whose title and content are already stored
+ * \param noteCount the number of notes to load, -1 if unknown
  * \return
  */
-bool DBManager::permanantlyRemoveAllNotes()
+bool DBManager::beginBulkLoad(bool deduplicate, int noteCount)
 {
     QSqlQuery query;
-    return query.exec(QString("DELETE FROM active_notes"));
+    query.exec(QStringLiteral("SELECT MAX(IFNULL((SELECT seq FROM sqlite_sequence WHERE name = 'active_notes'), 0), "
+                              "IFNULL((SELECT MAX(id) FROM active_notes), 0))"));
+    m_bulkLoadNextId = query.next() ? query.value(0).toInt() + 1 : 1;
+    m_bulkLoadFirstId = m_bulkLoadNextId;
+    query.finish();
+
+    m_bulkLoadedIds.clear();
+    m_bulkMergedIds.clear();
+    m_isBulkLoading = true;
+    m_isBulkDeduplicating = deduplicate;
+    m_bulkNotesInserted = 0;
+    m_bulkNotesSkipped = 0;
+    m_bulkNotesMerged = 0;
+
+    m_isModificationIndexDropped = (noteCount == -1);
+    if(noteCount >= IMPORT_BATCH_SIZE){
+        query.exec(QStringLiteral("SELECT COUNT(*) FROM active_notes"));
+        qint64 storedCount = query.next() ? query.value(0).toLongLong() : 0;
+        query.finish();
+        m_isModificationIndexDropped = (qint64(noteCount) * INDEX_REBUILD_MIN_FRACTION >= storedCount);
+    }
+
+    if(!m_isModificationIndexDropped)
+        return true;
+
+    return execSchemaStatements({QStringLiteral("DROP INDEX IF EXISTS active_notes_modification_index")});
 }
 
 /*!
- * \brief DBManager::updateNote
- * \param note
+ * \brief The StoredNote struct
+ * A note found by its content hash during a deduplicated bulk load
+ */
+struct StoredNote{
+    int id;
+    qint64 creationDate;
+    qint64 modificationDate;
+};
+
+/*!
+ * \brief DBManager::bulkAddNotes
+ * Insert the notes BULK_INSERT_ROWS at a time with multi-row statements.
+ * Must be called between beginBulkLoad and endBulkLoad.
+ * The content hashes are computed on every core for large lists. When deduplicating,
+ * each chunk of hashes is looked up in one query on the content hash index and the
+ * chunk is probed against the result: a note already stored is skipped, or merged
+ * when it has an earlier creation date or a later modification date
+ * \param noteList
+ * \param keepIds keep the ids of the notes instead of giving them new ones
  * \return
  */
-bool DBManager::updateNote(NoteData* note)
+bool DBManager::bulkAddNotes(const QList<NoteData*>& noteList, bool keepIds)
 {
-    QSqlQuery query;
-    QString emptyStr;
+    QList<qint64> hashList;
+    if(noteList.size() >= PARALLEL_HASH_THRESHOLD){
+        hashList = QtConcurrent::blockingMapped<QList<qint64>>(noteList, noteContentHash);
+    }else{
+        hashList.reserve(noteList.size());
+        for(NoteData* note : noteList)
+            hashList.append(noteContentHash(note));
+    }
 
-    int id = note->id();
-    qint64 epochTimeDateModified = note->lastModificationdateTime().toMSecsSinceEpoch();
-    QString content = note->content().replace(QChar('\x0'), emptyStr);
-    QString fullTitle = note->fullTitle().replace(QChar('\x0'), emptyStr);
+    QHash<qint64, StoredNote> storedNotes;
+    for(int first = 0; first < noteList.size(); first += BULK_INSERT_ROWS){
+        int chunkSize = qMin(BULK_INSERT_ROWS, noteList.size() - first);
+
+        if(m_isBulkDeduplicating){
+            storedNotes.clear();
+            for(int row = 0; row < BULK_INSERT_ROWS; ++row)
+                m_findContentHashesQuery.bindValue(row, row < chunkSize ? QVariant(hashList.at(first + row))
+                                                                        : QVariant(QVariant::LongLong));
+            if(!m_findContentHashesQuery.exec()){
+                qWarning() << "DBManager::bulkAddNotes: " << m_findContentHashesQuery.lastError();
+                return false;
+            }
+            while(m_findContentHashesQuery.next()){
+                StoredNote stored;
+                stored.id = m_findContentHashesQuery.value(1).toInt();
+                stored.creationDate = m_findContentHashesQuery.value(2).toLongLong();
+                stored.modificationDate = m_findContentHashesQuery.value(3).toLongLong();
+                storedNotes.insert(m_findContentHashesQuery.value(0).toLongLong(), stored);
+            }
+            m_findContentHashesQuery.finish();
+        }
 
-    query.prepare(QStringLiteral("UPDATE active_notes SET modification_date = :date, content = :content, "
-                                 "full_title = :title WHERE id = :id"));
-    query.bindValue(QStringLiteral(":date"), epochTimeDateModified);
-    query.bindValue(QStringLiteral(":content"), content);
-    query.bindValue(QStringLiteral(":title"), fullTitle);
-    query.bindValue(QStringLiteral(":id"), id);
+        QVector<int> insertedRows;
+        insertedRows.reserve(chunkSize);
+        for(int row = first; row < first + chunkSize; ++row){
+            if(!m_isBulkDeduplicating){
+                insertedRows.append(row);
+                continue;
+            }
+
+            NoteData* note = noteList.at(row);
+            qint64 epochTimeDateCreated = note->creationDate();
+            qint64 epochTimeDateModified = note->lastModificationDate() == -1 ? epochTimeDateCreated
+                                                                              : note->lastModificationDate();
+
+            auto stored = storedNotes.find(hashList.at(row));
+            if(stored == storedNotes.end()){
+                // a later copy in the same chunk is a duplicate of this one
+                StoredNote inserted;
+                inserted.id = -1;
+                inserted.creationDate = epochTimeDateCreated;
+                inserted.modificationDate = epochTimeDateModified;
+                storedNotes.insert(hashList.at(row), inserted);
+                insertedRows.append(row);
+            }else if(stored->id != -1
+                     && (epochTimeDateCreated < stored->creationDate || epochTimeDateModified > stored->modificationDate)){
+                m_mergeNoteQuery.bindValue(QStringLiteral(":created"), epochTimeDateCreated);
+                m_mergeNoteQuery.bindValue(QStringLiteral(":modified"), epochTimeDateModified);
+                m_mergeNoteQuery.bindValue(QStringLiteral(":id"), stored->id);
+                if(!m_mergeNoteQuery.exec()){
+                    qWarning() << "DBManager::bulkAddNotes: " << m_mergeNoteQuery.lastError();
+                    return false;
+                }
+                stored->creationDate = qMin(stored->creationDate, epochTimeDateCreated);
+                stored->modificationDate = qMax(stored->modificationDate, epochTimeDateModified);
+                m_bulkMergedIds.append(stored->id);
+                ++m_bulkNotesMerged;
+            }else{
+                ++m_bulkNotesSkipped;
+            }
+        }
 
-    if (!query.exec()) {
-        qWarning () << __func__ << ": " << query.lastError();
+        int rowCount = insertedRows.size();
+        if(rowCount == 0)
+            continue;
+
+        QSqlQuery remainderNotesQuery;
+        QSqlQuery remainderBodiesQuery;
+        if(rowCount < BULK_INSERT_ROWS){
+            remainderNotesQuery.prepare(bulkInsertStatement(rowCount, false));
+            remainderBodiesQuery.prepare(bulkInsertStatement(rowCount, true));
+        }
+        QSqlQuery& notesQuery = rowCount < BULK_INSERT_ROWS ? remainderNotesQuery : m_bulkAddNotesQuery;
+        QSqlQuery& bodiesQuery = rowCount < BULK_INSERT_ROWS ? remainderBodiesQuery : m_bulkAddBodiesQuery;
+
+        for(int row = 0; row < rowCount; ++row){
+            NoteData* note = noteList.at(insertedRows.at(row));
+            int id = keepIds ? note->id() : m_bulkLoadNextId++;
+            qint64 epochTimeDateCreated = note->creationDate();
+            qint64 epochTimeDateModified = note->lastModificationDate() == -1 ? epochTimeDateCreated
+                                                                              : note->lastModificationDate();
+            int encoding;
+
+            notesQuery.bindValue(row * 5, id);
+            notesQuery.bindValue(row * 5 + 1, epochTimeDateCreated);
+            notesQuery.bindValue(row * 5 + 2, epochTimeDateModified);
+            notesQuery.bindValue(row * 5 + 3, stripNullChars(note->fullTitle()));
+            notesQuery.bindValue(row * 5 + 4, hashList.at(insertedRows.at(row)));
+
+            bodiesQuery.bindValue(row * 3, id);
+            bodiesQuery.bindValue(row * 3 + 1, encodeNoteBody(stripNullChars(note->content()), &encoding));
+            bodiesQuery.bindValue(row * 3 + 2, encoding);
+
+            m_bulkLoadedIds.append(id);
+        }
+
+        if(!notesQuery.exec() || !bodiesQuery.exec()){
+            qWarning() << "DBManager::bulkAddNotes: " << notesQuery.lastError() << bodiesQuery.lastError();
+            return false;
+        }
+        m_bulkNotesInserted += rowCount;
     }
-    return (query.numRowsAffected() == 1);
+    return true;
 }
 
 /*!
- * \brief DBManager::migrateNote
- * \param note
+ * \brief DBManager::endBulkLoad
+ * Rebuild the modification date index in one pass if beginBulkLoad dropped it
+ * and add the loaded notes to the full text index. Nothing is rebuilt if the load failed,
+ * rolling back the transaction restores the index as it was
+ * \param isLoaded
  * \return
  */
-bool DBManager::migrateNote(NoteData* note)
+bool DBManager::endBulkLoad(bool isLoaded)
 {
-    QSqlQuery query;
+    m_isBulkLoading = false;
+    bool isIndexDropped = m_isModificationIndexDropped;
+    m_isModificationIndexDropped = false;
+    if(!isLoaded)
+        return false;
+
+    bool indexed = true;
+    if(isIndexDropped){
+        indexed = execSchemaStatements({
+            QStringLiteral("CREATE INDEX IF NOT EXISTS active_notes_modification_index "
+                           "ON active_notes (modification_date DESC, id)")});
+    }
 
-    QString emptyStr;
+    if(indexed && m_hasFullTextIndex && !m_bulkLoadedIds.isEmpty()){
+        std::sort(m_bulkLoadedIds.begin(), m_bulkLoadedIds.end());
+
+        QSqlQuery query;
+        query.setForwardOnly(true);
+        query.prepare(QStringLiteral("SELECT note_id, content, encoding FROM note_bodies "
+                                     "WHERE note_id BETWEEN :from AND :to"));
+        query.bindValue(QStringLiteral(":from"), m_bulkLoadedIds.first());
+        query.bindValue(QStringLiteral(":to"), m_bulkLoadedIds.last());
+        indexed = query.exec();
+
+        while(indexed && query.next()){
+            int id = query.value(0).toInt();
+            // notes between the loaded ones which are already indexed
+            if(!std::binary_search(m_bulkLoadedIds.constBegin(), m_bulkLoadedIds.constEnd(), id))
+                continue;
+
+            QString content = decodeNoteBody(query.value(1), query.value(2).toInt());
+            indexed = indexNoteContent(id, Q_NULLPTR, &content);
+        }
+    }
 
-    int id = note->id();
-    qint64 epochTimeDateCreated = note->creationDateTime().toMSecsSinceEpoch();
-    qint64 epochTimeDateModified = note->lastModificationdateTime().toMSecsSinceEpoch();
-    QString content = note->content()
-                            .replace("'","''")
-                            .replace(QChar('\x0'), emptyStr);
-    QString fullTitle = note->fullTitle()
-                              .replace("'","''")
-                              .replace(QChar('\x0'), emptyStr);
-
-    QString queryStr = QString("INSERT INTO active_notes "
-                               "VALUES (%1, %2, %3, -1, '%4', '%5');")
-                               .arg(id)
-                               .arg(epochTimeDateCreated)
-                               .arg(epochTimeDateModified)
-                               .arg(content)
-                               .arg(fullTitle);
-
-    query.exec(queryStr);
-    return (query.numRowsAffected() == 1);
+    m_bulkLoadedIds.clear();
+    m_bulkLoadedIds.squeeze();
+    return indexed;
 }
 
 /*!
- * \brief DBManager::migrateTrash
- * \param note
- * \return
+ * \brief DBManager::emitImportedNotes
+ * Hand the notes inserted or merged by the last bulk load to the application thread,
+ * which owns them from then on. A bulk load without kept ids inserts a single range of ids
  */
-bool DBManager::migrateTrash(NoteData* note)
+void DBManager::emitImportedNotes()
 {
+    QThread* applicationThread = QCoreApplication::instance()->thread();
+
+    QList<NoteData *> noteList;
+    noteList.reserve(m_bulkNotesInserted + m_bulkMergedIds.size());
+
+    auto readNotes = [&](QSqlQuery& query){
+        if(!query.exec()){
+            qWarning() << "DBManager::emitImportedNotes: " << query.lastError();
+            return;
+        }
+        while(query.next()){
+            NoteData* note = new NoteData();
+            note->setId(query.value(0).toInt());
+            note->setCreationDate(query.value(1).toLongLong());
+            note->setLastModificationDate(query.value(2).toLongLong());
+            note->setFullTitle(query.value(3).toString());
+            note->setContentLoaded(false);
+            note->moveToThread(applicationThread);
+            noteList.push_back(note);
+        }
+    };
+
     QSqlQuery query;
-    QString emptyStr;
+    query.setForwardOnly(true);
+    query.prepare(QStringLiteral("SELECT id, creation_date, modification_date, full_title FROM active_notes "
+                                 "WHERE id >= :first AND id < :next"));
+    query.bindValue(QStringLiteral(":first"), m_bulkLoadFirstId);
+    query.bindValue(QStringLiteral(":next"), m_bulkLoadNextId);
+    readNotes(query);
+
+    query.prepare(QStringLiteral("SELECT id, creation_date, modification_date, full_title FROM active_notes "
+                                 "WHERE id = :id"));
+    // a note can be merged more than once by the same import, or be one it inserted
+    std::sort(m_bulkMergedIds.begin(), m_bulkMergedIds.end());
+    m_bulkMergedIds.erase(std::unique(m_bulkMergedIds.begin(), m_bulkMergedIds.end()), m_bulkMergedIds.end());
+    for(int id : m_bulkMergedIds){
+        if(id >= m_bulkLoadFirstId)
+            break;
+        query.bindValue(QStringLiteral(":id"), id);
+        readNotes(query);
+    }
+    m_bulkMergedIds.clear();
 
-    int id = note->id();
-    qint64 epochTimeDateCreated = note->creationDateTime().toMSecsSinceEpoch();
-    qint64 epochTimeDateModified = note->lastModificationdateTime().toMSecsSinceEpoch();
-    qint64 epochTimeDateDeleted = note->deletionDateTime().toMSecsSinceEpoch();
-    QString content = note->content()
-                            .replace("'","''")
-                            .replace(QChar('\x0'), emptyStr);
-    QString fullTitle = note->fullTitle()
-                              .replace("'","''")
-                              .replace(QChar('\x0'), emptyStr);
-
-    QString queryStr = QString("INSERT INTO deleted_notes "
-                               "VALUES (%1, %2, %3, %4, '%5', '%6');")
-                               .arg(id)
-                               .arg(epochTimeDateCreated)
-                               .arg(epochTimeDateModified)
-                               .arg(epochTimeDateDeleted)
-                               .arg(content)
-                               .arg(fullTitle);
-
-    query.exec(queryStr);
-    return (query.numRowsAffected() == 1);
+    emit notesImported(noteList);
 }
 
 /*!
- * \brief DBManager::onNotesListRequested
+ * \brief DBManager::beginJob
+ * \return the progress of the job, to hand to the thread running it
  */
-void DBManager::onNotesListRequested()
+DBManager::JobProgress DBManager::beginJob()
 {
-    int noteCounter;
-    QList<NoteData *> noteList;
-
-    noteCounter = getLastRowID();
-    noteList    = getAllNotes();
+    m_isJobCancelled.storeRelease(0);
 
-    emit notesReceived(noteList, noteCounter);
+    JobProgress progress;
+    progress.timer.start();
+    // report the first note right away
+    progress.lastReportTime = -JOB_PROGRESS_INTERVAL;
+    return progress;
 }
 
 /*!
- * \brief DBManager::onOpenDBManagerRequested
- * \param path
- * \param doCreate
+ * \brief DBManager::isJobCancelled
+ * \return
  */
-void DBManager::onOpenDBManagerRequested(QString path, bool doCreate)
+bool DBManager::isJobCancelled() const
 {
-    open(path, doCreate);
+    return m_isJobCancelled.loadAcquire() != 0;
 }
 
 /*!
- * \brief DBManager::onCreateUpdateRequested
- * \param note
+ * \brief DBManager::reportJobProgress
+ * Emit jobProgress at most every JOB_PROGRESS_INTERVAL ms, unless 'force' is set
+ * \param progress
+ * \param notesProcessed
+ * \param notesTotal -1 if unknown
+ * \param bytesProcessed
+ * \param bytesTotal
+ * \param force
  */
-void DBManager::onCreateUpdateRequested(NoteData* note)
+void DBManager::reportJobProgress(JobProgress* progress, qint64 notesProcessed, qint64 notesTotal,
+                                  qint64 bytesProcessed, qint64 bytesTotal, bool force)
 {
-    bool exists = isNoteExist(note);
+    qint64 elapsed = progress->timer.elapsed();
+    if(!force && elapsed - progress->lastReportTime < JOB_PROGRESS_INTERVAL)
+        return;
 
-    if(exists)
-        updateNote(note);
-    else
-        addNote(note);
+    progress->lastReportTime = elapsed;
+    double notesPerSecond = notesProcessed * 1000.0 / qMax(elapsed, qint64(1));
+    emit jobProgress(notesProcessed, notesTotal, bytesProcessed, bytesTotal, notesPerSecond);
 }
 
 /*!
- * \brief DBManager::onDeleteNoteRequested
- * \param note
+ * \brief DBManager::importNotesFile
+ * Add the notes of a backup file, read and inserted IMPORT_BATCH_SIZE at a time
+ * \param fileName
+ * \param deduplicate skip or merge the notes already stored
+ * \param progress
+ * \return false if the job was cancelled or the file can't be read
  */
-void DBManager::onDeleteNoteRequested(NoteData* note)
+bool DBManager::importNotesFile(const QString& fileName, bool deduplicate, JobProgress* progress)
 {
-    removeNote(note);
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly)){
+        qWarning() << "DBManager::importNotesFile: " << file.errorString();
+        return false;
+    }
+
+    NoteBackupReader reader(&file);
+    qint64 notesProcessed = 0;
+    qint64 bytesTotal = file.size();
+
+    QList<NoteData*> batch;
+    batch.reserve(IMPORT_BATCH_SIZE);
+    beginBulkLoad(deduplicate, reader.noteCount());
+
+    bool isLoaded = true;
+    NoteData* note;
+    do{
+        note = reader.readNext();
+        if(note != Q_NULLPTR)
+            batch.append(note);
+
+        if(batch.size() == IMPORT_BATCH_SIZE || (note == Q_NULLPTR && !batch.isEmpty())){
+            isLoaded = bulkAddNotes(batch, false) && !isJobCancelled();
+            notesProcessed += batch.size();
+            qDeleteAll(batch);
+            batch.clear();
+
+            reportJobProgress(progress, notesProcessed, reader.noteCount(), file.pos(), bytesTotal);
+        }
+    }while(isLoaded && note != Q_NULLPTR);
+
+    qDeleteAll(batch);
+    if(isLoaded && isJobCancelled())
+        isLoaded = false;
+    if(!endBulkLoad(isLoaded))
+        return false;
+
+    reportJobProgress(progress, notesProcessed, reader.noteCount(), file.pos(), bytesTotal, true);
+    return true;
 }
 
 /*!
- * \brief DBManager::onImportNotesRequested
- * \param noteList
+ * \brief DBManager::onImportNotesFileRequested
+ * Add the notes of a backup file in one transaction,
+ * rolled back if the job is cancelled
+ * \param fileName
  */
-void DBManager::onImportNotesRequested(QList<NoteData *> noteList) {
+void DBManager::onImportNotesFileRequested(QString fileName)
+{
+    flushPendingSaves();
+    JobProgress progress = beginJob();
+
     QSqlDatabase::database().transaction();
-    for(NoteData* note : noteList)
-        addNote(note);
-    QSqlDatabase::database().commit();
+    bool completed = importNotesFile(fileName, true, &progress);
+    if(completed){
+        QSqlDatabase::database().commit();
+        emitImportedNotes();
+        emit importFinished(m_bulkNotesInserted, m_bulkNotesSkipped, m_bulkNotesMerged);
+    }else{
+        QSqlDatabase::database().rollback();
+    }
+
+    emit jobFinished(completed);
 }
 
 /*!
- * \brief DBManager::onRestoreNotesRequested
- * \param noteList
+ * \brief DBManager::onRestoreNotesFileRequested
+ * Replace all the notes with the ones of a backup file.
+ * A cancelled restore leaves the notes as they were
+ * \param fileName
  */
-void DBManager::onRestoreNotesRequested(QList<NoteData*> noteList) {
-    this->permanantlyRemoveAllNotes();
-    this->onImportNotesRequested(noteList);
+void DBManager::onRestoreNotesFileRequested(QString fileName)
+{
+    flushPendingSaves();
+    JobProgress progress = beginJob();
+
+    QSqlDatabase::database().transaction();
+    bool completed = permanantlyRemoveAllNotes() && importNotesFile(fileName, false, &progress);
+    if(completed)
+        QSqlDatabase::database().commit();
+    else
+        QSqlDatabase::database().rollback();
+
+    emit jobFinished(completed);
 }
 
 /*!
  * \brief DBManager::onExportNotesRequested
+ * Commit the queued saves, then export on a reader thread
+ * so saves go on while the file is written
  * \param fileName
  */
 void DBManager::onExportNotesRequested(QString fileName)
 {
-    QList<NoteData *> noteList;
+    flushPendingSaves();
+    JobProgress progress = beginJob();
+
+    runOnReader([this, fileName, progress](){exportNotes(fileName, progress);});
+}
+
+/*!
+ * \brief DBManager::exportNotes
+ * Write the notes to a backup file as they are read from the database,
+ * without loading them all at once. The file is removed if the job is cancelled
+ * \param fileName
+ * \param progress
+ */
+void DBManager::exportNotes(const QString& fileName, JobProgress progress)
+{
     QFile file(fileName);
-    file.open(QIODevice::WriteOnly);
-    QDataStream out(&file);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
-    out.setVersion(QDataStream::Qt_5_6);
-#elif QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
-    out.setVersion(QDataStream::Qt_5_4);
-#elif QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
-    out.setVersion(QDataStream::Qt_5_2);
-#endif
-    noteList = getAllNotes();
-    out << noteList;
+    if(!file.open(QIODevice::WriteOnly)){
+        qWarning() << "DBManager::onExportNotesRequested: " << file.errorString();
+        emit jobFinished(false);
+        return;
+    }
+
+    NoteBackupWriter writer(&file);
+
+    // the count and the notes are read from the same snapshot
+    QSqlDatabase database = readerConnection();
+    database.transaction();
+
+    QSqlQuery query(database);
+    query.exec(QStringLiteral("SELECT COUNT(*) FROM active_notes"));
+    qint64 notesTotal = query.next() ? query.value(0).toLongLong() : -1;
+    query.finish();
+
+    query.setForwardOnly(true);
+    bool completed = query.exec(QStringLiteral("SELECT id, creation_date, modification_date, content, full_title, encoding "
+                                               "FROM active_notes LEFT JOIN note_bodies ON note_id = id"));
+    if(!completed)
+        qWarning() << "DBManager::onExportNotesRequested: " << query.lastError();
+
+    NoteData note;
+    qint64 notesProcessed = 0;
+    while(completed && query.next()){
+        note.setId(query.value(0).toInt());
+        note.setCreationDate(query.value(1).toLongLong());
+        note.setLastModificationDate(query.value(2).toLongLong());
+        note.setContent(decodeNoteBody(query.value(3), query.value(5).toInt()));
+        note.setFullTitle(query.value(4).toString());
+
+        completed = writer.writeNote(&note) && !isJobCancelled();
+
+        ++notesProcessed;
+        reportJobProgress(&progress, notesProcessed, notesTotal, file.pos(), -1);
+    }
+    query.finish();
+    database.commit();
+
+    completed = completed && writer.finish();
     file.close();
 
-    qDeleteAll(noteList);
-    noteList.clear();
+    if(completed)
+        reportJobProgress(&progress, notesProcessed, notesTotal, file.size(), file.size(), true);
+    else
+        file.remove();
+
+    emit jobFinished(completed);
 }
 
 /*!
@@ -459,9 +2569,12 @@ void DBManager::onExportNotesRequested(QString fileName)
 void DBManager::onMigrateNotesRequested(QList<NoteData *> noteList)
 {
     QSqlDatabase::database().transaction();
-    for(NoteData* note : noteList)
-        migrateNote(note);
-    QSqlDatabase::database().commit();
+    beginBulkLoad(false, noteList.size());
+    bool loaded = bulkAddNotes(noteList, true);
+    if(endBulkLoad(loaded))
+        QSqlDatabase::database().commit();
+    else
+        QSqlDatabase::database().rollback();
 
     qDeleteAll(noteList);
     noteList.clear();
@@ -488,5 +2601,6 @@ void DBManager::onMigrateTrashRequested(QList<NoteData *> noteList)
  */
 void DBManager::onForceLastRowIndexValueRequested(int index)
 {
+    flushPendingSaves();
     forceLastRowIndexValue(index);
 }
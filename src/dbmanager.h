@@ -3,43 +3,214 @@
 
 #include "notedata.h"
 #include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <functional>
 #include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
 
 class DBManager : public QObject
 {
     Q_OBJECT
+
+    friend class tst_DBManager;
+
 public:
+    enum class DurabilityProfile{
+        Safe = 0,
+        Balanced,
+        Fast
+    };
+
+    enum class BodyCompression{
+        None = 0,
+        Zlib,
+        Zstd
+    };
+
     explicit DBManager(QObject *parent = Q_NULLPTR);
+    ~DBManager();
+
+    void setDurabilityProfile(DurabilityProfile profile);
+    static DurabilityProfile durabilityProfileFromString(const QString& name);
+    void setBodyCompression(BodyCompression compression);
+    static BodyCompression bodyCompressionFromString(const QString& name);
+
+    void setTrashRetention(int maxAgeDays, int maxNotes);
+
+    void cancelJob();
+
+    static qint64 contentHash(const QString& title, const QString& content);
+
+    QString readNoteContent(int id);
 
 private:
+    // a body as writeNoteBody stored it, with the content hash of its note
+    struct WrittenBody{
+        qint64 contentHash;
+        QString content;
+    };
 
-    void open(const QString& path, bool doCreate = false);
-    void createTables();
+    // the progress of a job, owned by the thread running it
+    struct JobProgress{
+        QElapsedTimer timer;
+        qint64 lastReportTime;
+    };
+
+    QHash<int, NoteData*> m_pendingSaves;
+    QHash<int, WrittenBody> m_writtenBodies;
+    QTimer* m_writeBehindTimer;
+    QTimer* m_saveRetryTimer;
+    QTimer* m_walCheckpointTimer;
+    QTimer* m_trashRetentionTimer;
+    QThreadPool* m_readerPool;
+    QString m_databasePath;
+    QMutex m_readerConnectionsMutex;
+    QStringList m_readerConnectionNames;
+    QMutex m_notesListMutex;
+    DurabilityProfile m_durabilityProfile;
+    BodyCompression m_bodyCompression;
+    QSqlQuery m_getLastRowIDQuery;
+    QSqlQuery m_forceLastRowIndexQuery;
+    QSqlQuery m_getNoteQuery;
+    QSqlQuery m_getNoteContentQuery;
+    QSqlQuery m_getContentHashQuery;
+    QSqlQuery m_addNoteQuery;
+    QSqlQuery m_upsertNoteQuery;
+    QSqlQuery m_insertNoteQuery;
+    QSqlQuery m_addNoteBodyQuery;
+    QSqlQuery m_updateNoteBodyQuery;
+    QSqlQuery m_bulkAddNotesQuery;
+    QSqlQuery m_bulkAddBodiesQuery;
+    QSqlQuery m_findContentHashesQuery;
+    QSqlQuery m_mergeNoteQuery;
+    QSqlQuery m_revisionChainQuery;
+    QSqlQuery m_addRevisionQuery;
+    QSqlQuery m_getRevisionQuery;
+    QSqlQuery m_removeNoteQuery;
+    QSqlQuery m_trashNoteQuery;
+    QSqlQuery m_updateNoteQuery;
+    QSqlQuery m_purgeExpiredTrashQuery;
+    QSqlQuery m_purgeExcessTrashQuery;
+    QSqlQuery m_migrateTrashQuery;
+    QSqlQuery m_indexContentQuery;
+    QSqlQuery m_unindexContentQuery;
+    bool m_isUpsertSupported;
+    bool m_hasFullTextIndex;
+    bool m_isFullTextSearchAvailable;
+    qint64 m_fullTextBackfillNextId;
+    qint64 m_fullTextBackfillEndId;
+    QAtomicInt m_isJobCancelled;
+    bool m_isBulkLoading;
+    bool m_isModificationIndexDropped;
+    bool m_isBulkDeduplicating;
+    int m_bulkNotesInserted;
+    int m_bulkNotesSkipped;
+    int m_bulkNotesMerged;
+    int m_bulkLoadFirstId;
+    int m_bulkLoadNextId;
+    QVector<int> m_bulkLoadedIds;
+    QVector<int> m_bulkMergedIds;
+    int m_trashMaxAgeDays;
+    int m_trashMaxNotes;
+    bool m_isTrashRetentionRunning;
+    int m_trashNotesPurged;
+    qint64 m_trashPageCountBefore;
+
+    void open(const QString& path);
+    void configureConnection();
+    void checkpointWal(bool truncate);
+    void runOnReader(const std::function<void()>& function);
+    QSqlDatabase readerConnection();
+    qint64 pragmaValue(const QString& pragma);
+    bool isIdle() const;
+    bool execSchemaStatements(const QStringList& statements);
+    int  schemaVersion();
+    void migrateSchema();
+    bool applyMigrationStep(int version);
+    bool createTables();
+    bool createFullTextIndex(const QString& table, const QString& idColumn, const QStringList& columns);
+    bool splitNoteBodies();
+    bool compressNoteBodies();
+    bool backfill(const QString& name, qint64 fromId, qint64 toId);
+    bool backfillFullTextIndex(qint64 fromId, qint64 toId);
+    bool backfillContentHash(qint64 fromId, qint64 toId);
+    void updateFullTextSearchAvailability();
+    bool indexNoteContent(int id, const QString* oldContent, const QString* newContent);
+    QVariant encodeNoteBody(const QString& content, int* encoding) const;
+    static QString decodeNoteBody(const QVariant& data, int encoding);
+    bool readNoteBody(int id, QString* content);
+    void prepareQueries();
     int  getLastRowID();
     bool forceLastRowIndexValue(const int indexValue);
 
     NoteData* getNote(QString id);
-    bool isNoteExist(NoteData* note);
 
     QList<NoteData *> getAllNotes();
+    QString getNoteContent(int id);
     bool addNote(NoteData* note);
     bool removeNote(NoteData* note);
     bool permanantlyRemoveAllNotes();
     bool updateNote(NoteData* note);
-    bool migrateNote(NoteData* note);
+    bool writeNoteBody(NoteData* note, const qint64* storedHash = Q_NULLPTR);
+    bool recordRevision(int noteId, const QString* previousContent, const QString& content,
+                        qint64 modificationDate);
+    QString getNoteRevision(int noteId, int revision);
+    int  upsertNote(NoteData* note);
+    int  writeNote(NoteData* note);
+    void flushPendingSaves();
+    QList<int> searchNotes(const QString& keyword);
+    static QList<int> searchNotes(const QSqlDatabase& database, const QString& keyword,
+                                  bool isFullTextSearchAvailable);
+    void readNotesList(int noteCounter);
+    void exportNotes(const QString& fileName, JobProgress progress);
     bool migrateTrash(NoteData* note);
+    JobProgress beginJob();
+    bool isJobCancelled() const;
+    void reportJobProgress(JobProgress* progress, qint64 notesProcessed, qint64 notesTotal,
+                           qint64 bytesProcessed, qint64 bytesTotal, bool force = false);
+    bool importNotesFile(const QString& fileName, bool deduplicate, JobProgress* progress);
+    static QString bulkInsertStatement(int rowCount, bool isBody);
+    bool beginBulkLoad(bool deduplicate, int noteCount);
+    bool bulkAddNotes(const QList<NoteData*>& noteList, bool keepIds);
+    bool endBulkLoad(bool isLoaded);
+    void emitImportedNotes();
+
+private slots:
+    void runBackfillBatch();
+    void purgeTrashBatch();
+    void vacuumStep();
 
 signals:
-    void notesReceived(QList<NoteData*> noteList, int noteCounter);
+    void notesReceived(QList<NoteData*> noteList, int noteCounter, bool isLastPage);
+    void notesSaved(QList<int> noteIdList, QList<qint64> modificationDateList);
+    void notesSaveFailed(QList<int> noteIdList);
+    void jobProgress(qint64 notesProcessed, qint64 notesTotal,
+                     qint64 bytesProcessed, qint64 bytesTotal, double notesPerSecond);
+    void jobFinished(bool isCompleted);
+    void importFinished(int notesInserted, int notesSkipped, int notesMerged);
+    void notesImported(QList<NoteData*> noteList);
+    void trashPurged(int notesPurged, qint64 bytesReclaimed);
+    void searchFinished(QString keyword, QList<int> noteIdList);
 
 public slots:
 
     void onNotesListRequested();
-    void onOpenDBManagerRequested(QString path, bool doCreate);
+    void onOpenDBManagerRequested(QString path);
     void onCreateUpdateRequested(NoteData* note);
+    void onFlushRequested();
+    QString onNoteRevisionRequested(int id, int revision);
+    void onSearchRequested(QString keyword);
     void onDeleteNoteRequested(NoteData* note);
     void onImportNotesRequested(QList<NoteData *> noteList);
-    void onRestoreNotesRequested(QList<NoteData *> noteList);
+    void onImportNotesFileRequested(QString fileName);
+    void onRestoreNotesFileRequested(QString fileName);
     void onExportNotesRequested(QString fileName);
     void onMigrateNotesRequested(QList<NoteData *> noteList);
     void onMigrateTrashRequested(QList<NoteData *> noteList);
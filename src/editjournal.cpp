@@ -0,0 +1,349 @@
+#include "editjournal.h"
+#include "notedelta.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define JOURNAL_SYNC_INTERVAL 200
+#define JOURNAL_COMPACT_SIZE (4 * 1024 * 1024)
+
+/*!
+ * \brief syncToDisk
+ * \param fileDescriptor
+ */
+static void syncToDisk(int fileDescriptor)
+{
+    if(fileDescriptor < 0)
+        return;
+#ifdef Q_OS_WIN
+    _commit(fileDescriptor);
+#else
+    fsync(fileDescriptor);
+#endif
+}
+
+/*!
+ * \brief EditJournal::EditJournal
+ * \param parent
+ */
+EditJournal::EditJournal(QObject* parent)
+    : QObject(parent),
+      m_syncTimer(new QTimer(this))
+{
+    m_syncTimer->setSingleShot(true);
+    m_syncTimer->setInterval(JOURNAL_SYNC_INTERVAL);
+    connect(m_syncTimer, &QTimer::timeout, this, &EditJournal::sync);
+}
+
+/*!
+ * \brief EditJournal::~EditJournal
+ */
+EditJournal::~EditJournal()
+{
+    sync();
+}
+
+/*!
+ * \brief EditJournal::open
+ * Open the journal at 'path', creating it if needed.
+ * Call replay before logging anything new
+ * \param path
+ * \return
+ */
+bool EditJournal::open(const QString& path)
+{
+    m_file.setFileName(path);
+    if(!m_file.open(QIODevice::ReadWrite)){
+        qWarning() << "EditJournal::open: " << m_file.errorString();
+        return false;
+    }
+
+    return m_file.seek(m_file.size());
+}
+
+/*!
+ * \brief EditJournal::replay
+ * Read back the edits left by a session that ended before they were saved.
+ * Reading stops at the first record cut short or damaged by the crash,
+ * which is removed from the file. The edits read back stay in the journal
+ * until markSaved is called for them
+ * \return the last logged state of each note not saved yet, owned by the caller
+ */
+QList<NoteData*> EditJournal::replay()
+{
+    QHash<int, JournaledNote> notes;
+    qint64 validSize = 0;
+
+    m_file.seek(0);
+    QDataStream stream(&m_file);
+    stream.setVersion(QDataStream::Qt_5_2);
+
+    while(!stream.atEnd()){
+        quint32 size = 0;
+        quint16 checksum = 0;
+        stream >> size >> checksum;
+        if(stream.status() != QDataStream::Ok || size == 0 || qint64(size) > m_file.size() - m_file.pos())
+            break;
+
+        QByteArray block(int(size), Qt::Uninitialized);
+        if(stream.readRawData(block.data(), int(size)) != int(size)
+                || qChecksum(block.constData(), size) != checksum)
+            break;
+        validSize = m_file.pos();
+
+        quint8 type = quint8(block.at(0));
+        QDataStream record(block.mid(1));
+        record.setVersion(QDataStream::Qt_5_2);
+        qint32 id = 0;
+        record >> id;
+
+        if(type == RecordType::Snapshot){
+            JournaledNote note;
+            record >> note.creationDate >> note.modificationDate >> note.content;
+            note.isSaved = false;
+            notes.insert(id, note);
+        }else if(type == RecordType::Delta){
+            qint64 modificationDate = 0;
+            QByteArray delta;
+            record >> modificationDate >> delta;
+
+            auto it = notes.find(id);
+            bool ok = false;
+            QString content = (it != notes.end()) ? NoteDelta::apply(it->content, delta, &ok) : QString();
+            if(ok){
+                it->content = content;
+                it->modificationDate = modificationDate;
+                it->isSaved = false;
+            }
+        }else if(type == RecordType::Removal){
+            notes.remove(id);
+        }else if(type == RecordType::Saved){
+            qint64 modificationDate = 0;
+            record >> modificationDate;
+
+            auto it = notes.find(id);
+            if(it != notes.end() && it->modificationDate <= modificationDate)
+                it->isSaved = true;
+        }
+    }
+
+    m_file.resize(validSize);
+    m_file.seek(validSize);
+    m_notes = notes;
+
+    QList<NoteData*> noteList;
+    for(auto it = notes.constBegin(); it != notes.constEnd(); ++it){
+        if(it->isSaved)
+            continue;
+
+        NoteData* note = new NoteData();
+        note->setId(it.key());
+        note->setCreationDate(it->creationDate);
+        note->setLastModificationDate(it->modificationDate);
+        note->setContent(it->content);
+        noteList.append(note);
+    }
+
+    return noteList;
+}
+
+/*!
+ * \brief EditJournal::logEdit
+ * Log the content of a note as it is now in the editor
+ * \param noteId
+ * \param creationDate only logged with the first edit of the note
+ * \param modificationDate
+ * \param content
+ */
+void EditJournal::logEdit(int noteId, qint64 creationDate, qint64 modificationDate, const QString& content)
+{
+    if(!m_file.isOpen())
+        return;
+
+    auto it = m_notes.find(noteId);
+    if(it == m_notes.end()){
+        JournaledNote journaled;
+        journaled.creationDate = creationDate;
+        journaled.modificationDate = modificationDate;
+        journaled.content = content;
+        journaled.isSaved = false;
+
+        m_notes.insert(noteId, journaled);
+        writeRecord(&m_file, RecordType::Snapshot, snapshotPayload(noteId, journaled));
+        return;
+    }
+
+    QByteArray payload;
+    QDataStream record(&payload, QIODevice::WriteOnly);
+    record.setVersion(QDataStream::Qt_5_2);
+    record << qint32(noteId) << modificationDate << NoteDelta::encode(it->content, content);
+
+    it->content = content;
+    it->modificationDate = modificationDate;
+    it->isSaved = false;
+
+    writeRecord(&m_file, RecordType::Delta, payload);
+}
+
+/*!
+ * \brief EditJournal::logRemoval
+ * Forget the edits of a note that was deleted
+ * \param noteId
+ */
+void EditJournal::logRemoval(int noteId)
+{
+    if(!m_file.isOpen() || !m_notes.contains(noteId))
+        return;
+
+    QByteArray payload;
+    QDataStream record(&payload, QIODevice::WriteOnly);
+    record.setVersion(QDataStream::Qt_5_2);
+    record << qint32(noteId);
+
+    m_notes.remove(noteId);
+    writeRecord(&m_file, RecordType::Removal, payload);
+}
+
+/*!
+ * \brief EditJournal::markSaved
+ * The database committed these notes as they were at these modification dates,
+ * which is logged so a replay skips them.
+ * Once every logged edit is saved the journal is emptied,
+ * a journal still growing past JOURNAL_COMPACT_SIZE is compacted instead
+ * \param noteIdList
+ * \param modificationDateList
+ */
+void EditJournal::markSaved(const QList<int>& noteIdList, const QList<qint64>& modificationDateList)
+{
+    for(int i = 0; i < noteIdList.size() && i < modificationDateList.size(); ++i){
+        auto it = m_notes.find(noteIdList.at(i));
+        if(it == m_notes.end() || it->isSaved || it->modificationDate > modificationDateList.at(i))
+            continue;
+
+        it->isSaved = true;
+        if(m_file.isOpen()){
+            QByteArray payload;
+            QDataStream record(&payload, QIODevice::WriteOnly);
+            record.setVersion(QDataStream::Qt_5_2);
+            record << qint32(it.key()) << modificationDateList.at(i);
+            writeRecord(&m_file, RecordType::Saved, payload);
+        }
+    }
+
+    for(const JournaledNote& note : m_notes){
+        if(!note.isSaved){
+            if(m_file.size() > JOURNAL_COMPACT_SIZE)
+                compact();
+            return;
+        }
+    }
+
+    clear();
+}
+
+/*!
+ * \brief EditJournal::clear
+ * Empty the journal, every edit it holds is in the database
+ */
+void EditJournal::clear()
+{
+    m_notes.clear();
+    if(!m_file.isOpen())
+        return;
+
+    m_syncTimer->stop();
+    m_file.resize(0);
+    m_file.seek(0);
+    syncToDisk(m_file.handle());
+}
+
+/*!
+ * \brief EditJournal::snapshotPayload
+ * \param noteId
+ * \param note
+ * \return
+ */
+QByteArray EditJournal::snapshotPayload(int noteId, const JournaledNote& note)
+{
+    QByteArray payload;
+    QDataStream record(&payload, QIODevice::WriteOnly);
+    record.setVersion(QDataStream::Qt_5_2);
+    record << qint32(noteId) << note.creationDate << note.modificationDate << note.content;
+    return payload;
+}
+
+/*!
+ * \brief EditJournal::writeRecord
+ * Append a record: its size and checksum, then its type and payload.
+ * The record reaches the disk with the next sync
+ * \param device
+ * \param type
+ * \param payload
+ * \return
+ */
+bool EditJournal::writeRecord(QIODevice* device, RecordType type, const QByteArray& payload)
+{
+    QByteArray block;
+    block.reserve(payload.size() + 1);
+    block.append(char(type));
+    block.append(payload);
+
+    QDataStream stream(device);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream << quint32(block.size()) << qChecksum(block.constData(), uint(block.size()));
+    stream.writeRawData(block.constData(), block.size());
+
+    if(device == &m_file && !m_syncTimer->isActive())
+        m_syncTimer->start();
+
+    return stream.status() == QDataStream::Ok;
+}
+
+/*!
+ * \brief EditJournal::compact
+ * Replace the journal with one snapshot per note that still has unsaved edits.
+ * The new journal is written aside and swapped in once complete
+ */
+void EditJournal::compact()
+{
+    QString path = m_file.fileName();
+
+    QSaveFile compacted(path);
+    if(!compacted.open(QIODevice::WriteOnly))
+        return;
+
+    for(auto it = m_notes.begin(); it != m_notes.end();){
+        if(it->isSaved){
+            it = m_notes.erase(it);
+        }else{
+            writeRecord(&compacted, RecordType::Snapshot, snapshotPayload(it.key(), *it));
+            ++it;
+        }
+    }
+
+    m_syncTimer->stop();
+    m_file.close();
+    if(!compacted.commit())
+        qWarning() << "EditJournal::compact: " << compacted.errorString();
+
+    open(path);
+}
+
+/*!
+ * \brief EditJournal::sync
+ * Push the records written since the last sync to the disk
+ */
+void EditJournal::sync()
+{
+    if(!m_file.isOpen())
+        return;
+
+    m_file.flush();
+    syncToDisk(m_file.handle());
+}
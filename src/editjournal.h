@@ -0,0 +1,61 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include "notedata.h"
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+
+/*!
+ * \brief The EditJournal class
+ * Append-only log of the edits made in the editor that are not in the database yet.
+ * The first edit of a note is logged as its whole content, the next ones as a
+ * NoteDelta of the previous edit, and the saves are logged as they are committed.
+ * Writes are synced to disk in batches, and the journal is emptied once every
+ * logged edit has been saved
+ */
+class EditJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit EditJournal(QObject* parent = Q_NULLPTR);
+    ~EditJournal();
+
+    bool open(const QString& path);
+    QList<NoteData*> replay();
+    void logEdit(int noteId, qint64 creationDate, qint64 modificationDate, const QString& content);
+    void logRemoval(int noteId);
+    void markSaved(const QList<int>& noteIdList, const QList<qint64>& modificationDateList);
+    void clear();
+
+private:
+    enum RecordType : quint8 {
+        Snapshot = 0,
+        Delta,
+        Removal,
+        Saved
+    };
+
+    struct JournaledNote{
+        qint64 creationDate;
+        qint64 modificationDate;
+        QString content;
+        bool isSaved;
+    };
+
+    QFile m_file;
+    QTimer* m_syncTimer;
+    QHash<int, JournaledNote> m_notes;
+
+    static QByteArray snapshotPayload(int noteId, const JournaledNote& note);
+    bool writeRecord(QIODevice* device, RecordType type, const QByteArray& payload);
+    void compact();
+
+private slots:
+    void sync();
+};
+
+#endif // EDITJOURNAL_H
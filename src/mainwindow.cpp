@@ -9,6 +9,7 @@
 #include "notewidgetdelegate.h"
 #include "qxtglobalshortcut.h"
 #include "updaterwindow.h"
+#include "notebackup.h"
 
 #include <QScrollBar>
 #include <QShortcut>
@@ -23,6 +24,7 @@
 #include <QWidgetAction>
 
 #define FIRST_LINE_MAX 80
+#define MIGRATION_BATCH_SIZE 2000
 
 /*!
  * \brief MainWindow::MainWindow
@@ -52,9 +54,11 @@ MainWindow::MainWindow(QWidget *parent) :
     m_noteView(Q_NULLPTR),
     m_noteModel(new NoteModel(this)),
     m_deletedNotesModel(new NoteModel(this)),
-    m_proxyModel(new QSortFilterProxyModel(this)),
+    m_proxyModel(new NoteFilterProxyModel(this)),
     m_dbManager(Q_NULLPTR),
     m_dbThread(Q_NULLPTR),
+    m_jobProgressDialog(Q_NULLPTR),
+    m_editJournal(new EditJournal(this)),
     m_noteCounter(0),
     m_trashCounter(0),
     m_layoutMargin(10),
@@ -68,7 +72,8 @@ MainWindow::MainWindow(QWidget *parent) :
     m_isOperationRunning(false),
     m_dontShowUpdateWindow(false),
     m_alwaysStayOnTop(false),
-    m_useNativeWindowFrame(false)
+    m_useNativeWindowFrame(false),
+    m_reloadNotesAfterJob(false)
 {
     ui->setupUi(this);
     setupMainWindow();
@@ -99,6 +104,8 @@ MainWindow::MainWindow(QWidget *parent) :
  */
 void MainWindow::InitData()
 {
+    replayEditJournal();
+
     QFileInfo fi(m_settingsDatabase->fileName());
     QDir dir(fi.absolutePath());
     QString oldNoteDBPath(dir.path() + QStringLiteral("/Notes.ini"));
@@ -113,6 +120,11 @@ void MainWindow::InitData()
         pd->setMinimumDuration(0);
         pd->show();
 
+        connect(this, &MainWindow::migrationProgress, pd, [pd](int notesMigrated, int notesTotal){
+            pd->setMaximum(notesTotal);
+            pd->setValue(notesMigrated);
+        });
+
         setButtonsAndFieldsEnabled(false);
 
         QFutureWatcher<void>* watcher = new QFutureWatcher<void>(this);
@@ -507,17 +519,23 @@ void MainWindow::setupSignalsSlots()
 
     // MainWindow <-> DBManager
     connect(this, &MainWindow::requestNotesList,
-            m_dbManager,&DBManager::onNotesListRequested, Qt::BlockingQueuedConnection);
+            m_dbManager,&DBManager::onNotesListRequested, Qt::QueuedConnection);
     connect(this, &MainWindow::requestCreateUpdateNote,
-            m_dbManager, &DBManager::onCreateUpdateRequested, Qt::BlockingQueuedConnection);
+            m_dbManager, &DBManager::onCreateUpdateRequested, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestFlushPendingSaves,
+            m_dbManager, &DBManager::onFlushRequested, Qt::BlockingQueuedConnection);
     connect(this, &MainWindow::requestDeleteNote,
             m_dbManager, &DBManager::onDeleteNoteRequested);
-    connect(this, &MainWindow::requestRestoreNotes,
-            m_dbManager, &DBManager::onRestoreNotesRequested, Qt::BlockingQueuedConnection);
-    connect(this, &MainWindow::requestImportNotes,
-            m_dbManager, &DBManager::onImportNotesRequested, Qt::BlockingQueuedConnection);
+    connect(this, &MainWindow::requestRestoreNotesFile,
+            m_dbManager, &DBManager::onRestoreNotesFileRequested, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestImportNotesFile,
+            m_dbManager, &DBManager::onImportNotesFileRequested, Qt::QueuedConnection);
     connect(this, &MainWindow::requestExportNotes,
-            m_dbManager, &DBManager::onExportNotesRequested, Qt::BlockingQueuedConnection);
+            m_dbManager, &DBManager::onExportNotesRequested, Qt::QueuedConnection);
+    connect(m_dbManager, &DBManager::jobProgress, this, &MainWindow::onJobProgress);
+    connect(m_dbManager, &DBManager::jobFinished, this, &MainWindow::onJobFinished);
+    connect(m_dbManager, &DBManager::importFinished, this, &MainWindow::onImportFinished);
+    connect(m_dbManager, &DBManager::notesImported, this, &MainWindow::onNotesImported);
     connect(this, &MainWindow::requestMigrateNotes,
             m_dbManager, &DBManager::onMigrateNotesRequested, Qt::BlockingQueuedConnection);
     connect(this, &MainWindow::requestMigrateTrash,
@@ -525,7 +543,14 @@ void MainWindow::setupSignalsSlots()
     connect(this, &MainWindow::requestForceLastRowIndexValue,
             m_dbManager, &DBManager::onForceLastRowIndexValueRequested, Qt::BlockingQueuedConnection);
 
+    connect(this, &MainWindow::requestSearch,
+            m_dbManager, &DBManager::onSearchRequested, Qt::QueuedConnection);
+    connect(m_dbManager, &DBManager::searchFinished, this, &MainWindow::onSearchFinished);
     connect(m_dbManager, &DBManager::notesReceived, this, &MainWindow::loadNotes);
+    connect(m_dbManager, &DBManager::notesSaved, this, [this](QList<int> noteIdList, QList<qint64> modificationDateList){
+        m_editJournal->markSaved(noteIdList, modificationDateList);
+        m_noteModel->markContentSaved(noteIdList, modificationDateList);
+    });
 }
 
 /*!
@@ -643,6 +668,19 @@ void MainWindow::initializeSettingsDatabase()
     if(m_settingsDatabase->value(QStringLiteral("dontShowUpdateWindow"), "NULL") == "NULL")
         m_settingsDatabase->setValue(QStringLiteral("dontShowUpdateWindow"), m_dontShowUpdateWindow);
 
+    if(m_settingsDatabase->value(QStringLiteral("durabilityProfile"), "NULL") == "NULL")
+        m_settingsDatabase->setValue(QStringLiteral("durabilityProfile"), QStringLiteral("balanced"));
+
+    if(m_settingsDatabase->value(QStringLiteral("noteBodyCompression"), "NULL") == "NULL")
+        m_settingsDatabase->setValue(QStringLiteral("noteBodyCompression"), QStringLiteral("zlib"));
+
+    // 0 keeps deleted notes forever
+    if(m_settingsDatabase->value(QStringLiteral("trashRetentionDays"), "NULL") == "NULL")
+        m_settingsDatabase->setValue(QStringLiteral("trashRetentionDays"), 0);
+
+    if(m_settingsDatabase->value(QStringLiteral("trashMaxNotes"), "NULL") == "NULL")
+        m_settingsDatabase->setValue(QStringLiteral("trashMaxNotes"), 0);
+
     if(m_settingsDatabase->value(QStringLiteral("windowGeometry"), "NULL") == "NULL"){
         int initWidth = 733;
         int initHeight = 336;
@@ -674,7 +712,6 @@ void MainWindow::setupDatabases()
     m_settingsDatabase->setFallbacksEnabled(false);
     initializeSettingsDatabase();
 
-    bool doCreate = false;
     QFileInfo fi(m_settingsDatabase->fileName());
     QDir dir(fi.absolutePath());
     bool folderCreated = dir.mkpath(QStringLiteral("."));
@@ -689,14 +726,22 @@ void MainWindow::setupDatabases()
             qFatal("ERROR : Can't create database file");
 
         noteDBFile.close();
-        doCreate = true;
     }
 
     m_dbManager = new DBManager;
+    QString durabilityProfile = m_settingsDatabase->value(QStringLiteral("durabilityProfile")).toString();
+    m_dbManager->setDurabilityProfile(DBManager::durabilityProfileFromString(durabilityProfile));
+    QString bodyCompression = m_settingsDatabase->value(QStringLiteral("noteBodyCompression")).toString();
+    m_dbManager->setBodyCompression(DBManager::bodyCompressionFromString(bodyCompression));
+    m_dbManager->setTrashRetention(m_settingsDatabase->value(QStringLiteral("trashRetentionDays")).toInt(),
+                                   m_settingsDatabase->value(QStringLiteral("trashMaxNotes")).toInt());
+    // edits not saved yet survive a crash in the journal, see replayEditJournal
+    m_editJournal->open(dir.path() + QDir::separator() + QStringLiteral("notes.journal"));
+
     m_dbThread = new QThread;
     m_dbThread->setObjectName(QStringLiteral("dbThread"));
     m_dbManager->moveToThread(m_dbThread);
-    connect(m_dbThread, &QThread::started, [=](){emit requestOpenDBManager(noteDBFilePath, doCreate);});
+    connect(m_dbThread, &QThread::started, [=](){emit requestOpenDBManager(noteDBFilePath);});
     connect(this, &MainWindow::requestOpenDBManager, m_dbManager, &DBManager::onOpenDBManagerRequested);
     connect(m_dbThread, &QThread::finished, m_dbManager, &QObject::deleteLater);
     m_dbThread->start();
@@ -708,10 +753,14 @@ void MainWindow::setupDatabases()
 void MainWindow::setupModelView()
 {
     m_noteView = static_cast<NoteView*>(ui->listView);
+
+    // notes are loaded without their content, fetch it when it is needed.
+    // The model keeps the edits until they are saved, the committed content is enough
+    m_noteModel->setContentLoader([this](int noteId){
+        return m_dbManager->readNoteContent(noteId);
+    });
+
     m_proxyModel->setSourceModel(m_noteModel);
-    m_proxyModel->setFilterKeyColumn(0);
-    m_proxyModel->setFilterRole(NoteModel::NoteContent);
-    m_proxyModel->setFilterCaseSensitivity(Qt::CaseInsensitive);
 
     m_noteView->setItemDelegate(new NoteWidgetDelegate(m_noteView));
     m_noteView->setModel(m_proxyModel);
@@ -765,33 +814,17 @@ QString MainWindow::getFirstLine(const QString& str)
     return ts.readLine(FIRST_LINE_MAX);
 }
 
-/*!
- * \brief MainWindow::getQDateTime
- * Get a date string of a note from database and put it's data into a QDateTime object
- * This function is not efficient
- * If QVariant would include toStdString() it might help, aka: notesDatabase->value().toStdString
- * \param date
- * \return
- */
-QDateTime MainWindow::getQDateTime(QString date)
-{
-    QDateTime dateTime = QDateTime::fromString(date, Qt::ISODate);
-    return dateTime;
-}
-
 /*!
  * \brief MainWindow::getNoteDateEditor
- * Get the full date of the selected note from the database and return
- * it as a string in form for editorDateLabel
- * \param dateEdited
+ * Format the modification date of the selected note for editorDateLabel
+ * \param dateEdited milliseconds since epoch
  * \return
  */
-QString MainWindow::getNoteDateEditor(QString dateEdited)
+QString MainWindow::getNoteDateEditor(qint64 dateEdited)
 {
-    QDateTime dateTimeEdited(getQDateTime(dateEdited));
     QLocale usLocale(QLocale(QStringLiteral("en_US")));
 
-    return usLocale.toString(dateTimeEdited, QStringLiteral("MMMM d, yyyy, h:mm A"));
+    return usLocale.toString(QDateTime::fromMSecsSinceEpoch(dateEdited), QStringLiteral("MMMM d, yyyy, h:mm A"));
 }
 
 /*!
@@ -802,12 +835,12 @@ QString MainWindow::getNoteDateEditor(QString dateEdited)
  */
 NoteData* MainWindow::generateNote(const int noteID)
 {
-    NoteData* newNote = new NoteData(this);
+    NoteData* newNote = new NoteData();
     newNote->setId(noteID);
 
-    QDateTime noteDate = QDateTime::currentDateTime();
-    newNote->setCreationDateTime(noteDate);
-    newNote->setLastModificationDateTime(noteDate);
+    qint64 noteDate = QDateTime::currentMSecsSinceEpoch();
+    newNote->setCreationDate(noteDate);
+    newNote->setLastModificationDate(noteDate);
     newNote->setFullTitle(QStringLiteral("New Note"));
 
     return newNote;
@@ -829,14 +862,12 @@ void MainWindow::showNoteInEditor(const QModelIndex &noteIndex)
 
 
     QString content = noteIndex.data(NoteModel::NoteContent).toString();
-    QDateTime dateTime = noteIndex.data(NoteModel::NoteLastModificationDateTime).toDateTime();
+    qint64 modificationDate = noteIndex.data(NoteModel::NoteLastModificationDateTime).toLongLong();
     int scrollbarPos = noteIndex.data(NoteModel::NoteScrollbarPos).toInt();
 
     // set text and date
     m_textEdit->setText(content);
-    QString noteDate = dateTime.toString(Qt::ISODate);
-    QString noteDateEditor = getNoteDateEditor(noteDate);
-    m_editorDateLabel->setText(noteDateEditor);
+    m_editorDateLabel->setText(getNoteDateEditor(modificationDate));
     // set scrollbar position
     m_textEdit->verticalScrollBar()->setValue(scrollbarPos);
     m_textEdit->blockSignals(false);
@@ -846,25 +877,31 @@ void MainWindow::showNoteInEditor(const QModelIndex &noteIndex)
 
 /*!
  * \brief MainWindow::loadNotes
- * Load all the notes from database
- * add data to the models
- * sort them according to the date
- * update scrollbar stylesheet
+ * Load a page of notes from database
+ * pages arrive already sorted by date, each one is appended to the model
+ * the first note is selected as soon as the first page is shown
  * \param noteList
  * \param noteCounter
+ * \param isLastPage
  */
-void MainWindow::loadNotes(QList<NoteData *> noteList, int noteCounter)
+void MainWindow::loadNotes(QList<NoteData *> noteList, int noteCounter, bool isLastPage)
 {
+    bool isFirstPage = (m_noteModel->rowCount() == 0);
+
+    if(isFirstPage)
+        m_noteCounter = noteCounter;
+
+    // the model keeps a copy of each note and deletes it
     if(!noteList.isEmpty()){
         m_noteModel->addListNote(noteList);
-        m_noteModel->sort(0,Qt::AscendingOrder);
-    }
 
-    m_noteCounter = noteCounter;
+        if(isFirstPage)
+            selectFirstNote();
+    }
 
     // TODO: move this from here
-    createNewNoteIfEmpty();
-    selectFirstNote();
+    if(isLastPage)
+        createNewNoteIfEmpty();
 }
 
 /*!
@@ -877,6 +914,7 @@ void MainWindow::saveNoteToDB(const QModelIndex& noteIndex)
     if(noteIndex.isValid() && m_isContentModified){
         QModelIndex indexInSrc = m_proxyModel->mapToSource(noteIndex);
         NoteData* note = m_noteModel->getNote(indexInSrc);
+        // hand the snapshot to the write-behind queue, it owns it from now on
         if(note != Q_NULLPTR)
             emit requestCreateUpdateNote(note);
 
@@ -893,6 +931,7 @@ void MainWindow::removeNoteFromDB(const QModelIndex& noteIndex)
     if(noteIndex.isValid()){
         QModelIndex indexInSrc = m_proxyModel->mapToSource(noteIndex);
         NoteData* note = m_noteModel->getNote(indexInSrc);
+        m_editJournal->logRemoval(note->id());
         emit requestDeleteNote(note);
     }
 }
@@ -1133,7 +1172,8 @@ void MainWindow::onTextEditTextChanged()
     if(m_currentSelectedNoteProxy.isValid()){
         m_textEdit->blockSignals(true);
         QString content = m_currentSelectedNoteProxy.data(NoteModel::NoteContent).toString();
-        if(m_textEdit->toPlainText() != content){
+        QString editedContent = m_textEdit->toPlainText();
+        if(editedContent != content){
 
             // move note to the top of the list
             QModelIndex sourceIndex = m_proxyModel->mapToSource(m_currentSelectedNoteProxy);
@@ -1146,19 +1186,21 @@ void MainWindow::onTextEditTextChanged()
             }
 
             // Get the new data
-            QString firstline = getFirstLine(m_textEdit->toPlainText());
-            QDateTime dateTime = QDateTime::currentDateTime();
-            QString noteDate = dateTime.toString(Qt::ISODate);
-            m_editorDateLabel->setText(getNoteDateEditor(noteDate));
+            QString firstline = getFirstLine(editedContent);
+            qint64 modificationDate = QDateTime::currentMSecsSinceEpoch();
+            m_editorDateLabel->setText(getNoteDateEditor(modificationDate));
 
             // update model
             QMap<int, QVariant> dataValue;
-            dataValue[NoteModel::NoteContent] = QVariant::fromValue(m_textEdit->toPlainText());
+            dataValue[NoteModel::NoteContent] = QVariant::fromValue(editedContent);
             dataValue[NoteModel::NoteFullTitle] = QVariant::fromValue(firstline);
-            dataValue[NoteModel::NoteLastModificationDateTime] = QVariant::fromValue(dateTime);
+            dataValue[NoteModel::NoteLastModificationDateTime] = QVariant::fromValue(modificationDate);
 
             QModelIndex index = m_proxyModel->mapToSource(m_currentSelectedNoteProxy);
+            int noteId = index.data(NoteModel::NoteID).toInt();
+            qint64 creationDate = index.data(NoteModel::NoteCreationDateTime).toLongLong();
             m_noteModel->setItemData(index, dataValue);
+            m_editJournal->logEdit(noteId, creationDate, modificationDate, editedContent);
 
             m_isContentModified = true;
 
@@ -1198,7 +1240,7 @@ void MainWindow::onSearchEditTextChanged(const QString& keyword)
             m_searchEdit->blockSignals(true);
             m_currentSelectedNoteProxy = QModelIndex();
             QModelIndex index = m_noteModel->index(0);
-            m_noteModel->removeNote(index);
+            delete m_noteModel->removeNote(index);
             m_searchEdit->blockSignals(false);
 
             if(m_noteModel->rowCount() > 0){
@@ -1293,14 +1335,13 @@ void MainWindow::createNewNote()
             ++m_noteCounter;
             NoteData* tmpNote = generateNote(m_noteCounter);
             m_isTemp = true;
+            qint64 modificationDate = tmpNote->lastModificationDate();
 
-            // insert the new note to NoteModel
-            QModelIndex indexSrc = m_noteModel->insertNote(tmpNote, 0);
+            // add the new note to NoteModel, which takes it over
+            QModelIndex indexSrc = m_noteModel->addNote(tmpNote);
 
             // update the editor header date label
-            QString dateTimeFromDB = tmpNote->lastModificationdateTime().toString(Qt::ISODate);
-            QString dateTimeForEditor = getNoteDateEditor(dateTimeFromDB);
-            m_editorDateLabel->setText(dateTimeForEditor);
+            m_editorDateLabel->setText(getNoteDateEditor(modificationDate));
 
             // update the current selected index
             m_currentSelectedNoteProxy = m_proxyModel->mapFromSource(indexSrc);
@@ -1333,8 +1374,9 @@ void MainWindow::deleteNote(const QModelIndex &noteIndex, bool isFromUser)
         if(m_isTemp){
             m_isTemp = false;
             --m_noteCounter;
+            delete noteTobeRemoved;
         }else{
-            noteTobeRemoved->setDeletionDateTime(QDateTime::currentDateTime());
+            noteTobeRemoved->setDeletionDate(QDateTime::currentMSecsSinceEpoch());
             emit requestDeleteNote(noteTobeRemoved);
         }
 
@@ -1625,51 +1667,167 @@ void MainWindow::executeImport(const bool replace)
             QMessageBox::information(this, tr("Unable to open file"), file.errorString());
             return;
         }
-        QList<NoteData*> noteList;
-        QDataStream in(&file);
-#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
-        in.setVersion(QDataStream::Qt_5_6);
-#elif QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
-        in.setVersion(QDataStream::Qt_5_4);
-#elif QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
-        in.setVersion(QDataStream::Qt_5_2);
-#endif
-
+        // only check the file here, the notes are read and added one by one by the database manager
+        bool isValid = false;
         try {
-            in >> noteList;
+            NoteBackupReader reader(&file);
+            NoteData* firstNote = reader.readNext();
+            isValid = (firstNote != Q_NULLPTR);
+            delete firstNote;
         } catch (...) {
-            // Any exception deserializing will result in an empty note list and  the user will be notified
+            // Any exception deserializing will result in an invalid file and the user will be notified
         }
         file.close();
 
-        if (noteList.isEmpty()) {
+        if (!isValid) {
             QMessageBox::information(this, tr("Invalid file"), "Please select a valid notes export file");
             return;
         }
 
-        QProgressDialog* pd = new QProgressDialog(replace ? "Restoring Notes..."
-                                                          : "Importing Notes...", "", 0, 0, this);
-        pd->deleteLater();
-        pd->setCancelButton(Q_NULLPTR);
-        pd->setWindowFlags(Qt::Window | Qt::FramelessWindowHint);
-        pd->setMinimumDuration(0);
-        pd->show();
-        pd->setValue(1);
-
-        setButtonsAndFieldsEnabled(false);
+        // a restore replaces the whole list, imported notes are merged into it as they are
+        startJob(replace ? tr("Restoring Notes...") : tr("Importing Notes..."), replace);
 
         if(replace)
-            emit requestRestoreNotes(noteList);
+            emit requestRestoreNotesFile(fileName);
         else
-            emit requestImportNotes(noteList);
+            emit requestImportNotesFile(fileName);
+    }
+}
+
+/*!
+ * \brief MainWindow::startJob
+ * Show the progress of an export, import or restore running on the database thread.
+ * The buttons and fields stay disabled until the job is over
+ * \param label
+ * \param reloadNotesAfter reload the notes list once the job is over
+ */
+void MainWindow::startJob(const QString& label, bool reloadNotesAfter)
+{
+    m_reloadNotesAfterJob = reloadNotesAfter;
+
+    m_jobProgressDialog = new QProgressDialog(label, tr("Cancel"), 0, 0, this);
+    m_jobProgressDialog->setWindowFlags(Qt::Window | Qt::FramelessWindowHint);
+    m_jobProgressDialog->setAutoClose(false);
+    m_jobProgressDialog->setAutoReset(false);
+    m_jobProgressDialog->setMinimumDuration(0);
+    // only sets a flag, safe to call while the database thread is busy with the job
+    connect(m_jobProgressDialog, &QProgressDialog::canceled, this, [this](){
+        m_jobProgressDialog->setLabelText(tr("Cancelling..."));
+        m_dbManager->cancelJob();
+    });
+    m_jobProgressDialog->show();
+
+    setButtonsAndFieldsEnabled(false);
+}
+
+/*!
+ * \brief MainWindow::onJobProgress
+ * \param notesProcessed
+ * \param notesTotal
+ * \param bytesProcessed
+ * \param bytesTotal
+ * \param notesPerSecond
+ */
+void MainWindow::onJobProgress(qint64 notesProcessed, qint64 notesTotal,
+                               qint64 bytesProcessed, qint64 bytesTotal, double notesPerSecond)
+{
+    if(m_jobProgressDialog == Q_NULLPTR || m_jobProgressDialog->wasCanceled())
+        return;
 
-        setButtonsAndFieldsEnabled(true);
+    // the progress bar counts notes when their number is known, bytes otherwise
+    if(notesTotal > 0){
+        m_jobProgressDialog->setMaximum(int(notesTotal));
+        m_jobProgressDialog->setValue(int(notesProcessed));
+    }else if(bytesTotal > 0){
+        m_jobProgressDialog->setMaximum(1000);
+        m_jobProgressDialog->setValue(int(bytesProcessed * 1000 / bytesTotal));
+    }
 
+    m_jobProgressDialog->setLabelText(tr("%1 notes, %2 MB, %3 notes/s")
+                                      .arg(notesProcessed)
+                                      .arg(bytesProcessed / (1024.0 * 1024.0), 0, 'f', 1)
+                                      .arg(qRound(notesPerSecond)));
+}
+
+/*!
+ * \brief MainWindow::onJobFinished
+ * \param isCompleted false if the job failed or was cancelled
+ */
+void MainWindow::onJobFinished(bool isCompleted)
+{
+    if(m_jobProgressDialog == Q_NULLPTR)
+        return;
+
+    bool wasCanceled = m_jobProgressDialog->wasCanceled();
+    m_jobProgressDialog->deleteLater();
+    m_jobProgressDialog = Q_NULLPTR;
+
+    setButtonsAndFieldsEnabled(true);
+
+    if(!isCompleted && !wasCanceled)
+        QMessageBox::information(this, tr("Operation failed"), tr("The notes backup file couldn't be processed"));
+
+    if(isCompleted && !m_importSummary.isEmpty())
+        QMessageBox::information(this, tr("Notes imported"), m_importSummary);
+    m_importSummary.clear();
+
+    if(m_reloadNotesAfterJob && isCompleted){
         m_noteModel->clearNotes();
+        m_currentSelectedNoteProxy = QModelIndex();
         emit requestNotesList();
     }
 }
 
+/*!
+ * \brief MainWindow::onImportFinished
+ * Keep the counts of the import, shown once its job is finished
+ * \param notesInserted
+ * \param notesSkipped notes already stored
+ * \param notesMerged notes already stored, with their dates updated
+ */
+void MainWindow::onImportFinished(int notesInserted, int notesSkipped, int notesMerged)
+{
+    m_importSummary = tr("%1 notes added, %2 duplicates skipped, %3 duplicates merged")
+            .arg(notesInserted).arg(notesSkipped).arg(notesMerged);
+}
+
+/*!
+ * \brief MainWindow::onNotesImported
+ * Merge the notes added or updated by an import into the notes list,
+ * without reloading the notes that were already there
+ * \param noteList
+ */
+void MainWindow::onNotesImported(QList<NoteData *> noteList)
+{
+    int tempNoteId = m_isTemp ? m_noteCounter : -1;
+
+    QList<NoteData *> newNoteList;
+    newNoteList.reserve(noteList.size());
+    QHash<int, QMap<int, QVariant>> mergedNotesData;
+    for(NoteData* note : noteList){
+        m_noteCounter = qMax(m_noteCounter, note->id());
+
+        if(note->id() != tempNoteId && m_noteModel->noteIndex(note->id()).isValid()){
+            QMap<int, QVariant>& dataValue = mergedNotesData[note->id()];
+            dataValue[NoteModel::NoteCreationDateTime] = QVariant::fromValue(note->creationDate());
+            dataValue[NoteModel::NoteLastModificationDateTime] = QVariant::fromValue(note->lastModificationDate());
+            delete note;
+        }else{
+            newNoteList.append(note);
+        }
+    }
+    m_noteModel->setNotesData(mergedNotesData);
+
+    // the temporary note isn't stored yet, its id can have been given to an imported note
+    if(m_isTemp && m_noteCounter > tempNoteId){
+        ++m_noteCounter;
+        m_noteModel->setData(m_noteModel->noteIndex(tempNoteId), m_noteCounter, NoteModel::NoteID);
+    }
+
+    m_noteModel->addListNote(newNoteList);
+    m_currentSelectedNoteProxy = m_noteView->currentIndex();
+}
+
 /*!
  * \brief MainWindow::exportNotesFile
  * Called when the "Export Notes" menu button is clicked. this function will
@@ -1693,6 +1851,8 @@ void MainWindow::exportNotesFile(const bool clicked)
             return;
         }
         file.close();
+
+        startJob(tr("Exporting Notes..."), false);
         emit requestExportNotes(fileName);
     }
 }
@@ -1855,6 +2015,11 @@ void MainWindow::closeEvent(QCloseEvent* event)
         saveNoteToDB(m_currentSelectedNoteProxy);
     }
 
+    // wait for the queued saves to be committed before leaving, the journal
+    // is emptied by the notesSaved queued to this window if they all were
+    emit requestFlushPendingSaves();
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+
     m_settingsDatabase->setValue(QStringLiteral("dontShowUpdateWindow"), m_dontShowUpdateWindow);
 
     m_settingsDatabase->setValue(QStringLiteral("splitterSizes"), m_splitter->saveState());
@@ -2190,7 +2355,7 @@ void MainWindow::clearSearch()
     m_editorDateLabel->clear();
     m_textEdit->blockSignals(false);
 
-    m_proxyModel->setFilterFixedString(QString());
+    m_proxyModel->clearNoteIdFilter();
 
     m_clearButton->hide();
     m_searchEdit->setFocus();
@@ -2198,11 +2363,28 @@ void MainWindow::clearSearch()
 
 /*!
  * \brief MainWindow::findNotesContain
+ * Ask the full text index which notes match the keyword,
+ * the answer comes back to onSearchFinished
  * \param keyword
  */
 void MainWindow::findNotesContain(const QString& keyword)
 {
-    m_proxyModel->setFilterFixedString(keyword);
+    emit requestSearch(keyword);
+}
+
+/*!
+ * \brief MainWindow::onSearchFinished
+ * Only show the notes matching the keyword,
+ * unless the search text changed while the search was running
+ * \param keyword
+ * \param noteIdList
+ */
+void MainWindow::onSearchFinished(QString keyword, QList<int> noteIdList)
+{
+    if(keyword != m_searchEdit->text())
+        return;
+
+    m_proxyModel->setNoteIdFilter(noteIdList);
     m_clearButton->show();
 
     m_textEdit->blockSignals(true);
@@ -2215,6 +2397,8 @@ void MainWindow::findNotesContain(const QString& keyword)
     }else{
         m_currentSelectedNoteProxy = QModelIndex();
     }
+
+    highlightSearch();
 }
 
 /*!
@@ -2257,8 +2441,30 @@ void MainWindow::selectNote(const QModelIndex &noteIndex)
     }
 }
 
+/*!
+ * \brief MainWindow::replayEditJournal
+ * Save the edits the journal kept from a session that ended before they reached
+ * the database, before the notes are listed. The journal keeps them until
+ * notesSaved says they were committed
+ */
+void MainWindow::replayEditJournal()
+{
+    QList<NoteData*> noteList = m_editJournal->replay();
+    if(noteList.isEmpty())
+        return;
+
+    for(NoteData* note : noteList){
+        note->setFullTitle(getFirstLine(note->content()));
+        emit requestCreateUpdateNote(note);
+    }
+
+    emit requestFlushPendingSaves();
+}
+
 /*!
  * \brief MainWindow::checkMigration
+ * Move the notes of the legacy Notes.ini and Trash.ini into the database.
+ * Both files are read first so the progress covers the whole migration
  */
 void MainWindow::checkMigration()
 {
@@ -2266,97 +2472,123 @@ void MainWindow::checkMigration()
     QDir dir(fi.absolutePath());
 
     QString oldNoteDBPath(dir.path() + QDir::separator() + "Notes.ini");
-    if(QFile::exists(oldNoteDBPath))
-        migrateNote(oldNoteDBPath);
-
     QString oldTrashDBPath(dir.path() + QDir::separator() + "Trash.ini");
+
+    QVector<LegacyNote> legacyNotes;
+    if(QFile::exists(oldNoteDBPath)){
+        QSettings notesIni(oldNoteDBPath, QSettings::IniFormat);
+        m_noteCounter = notesIni.value(QStringLiteral("notesCounter"), "0").toInt();
+        legacyNotes = readLegacyNotes(oldNoteDBPath);
+    }
+
+    QVector<LegacyNote> legacyTrash;
+    if(QFile::exists(oldTrashDBPath))
+        legacyTrash = readLegacyNotes(oldTrashDBPath);
+
+    int notesTotal = legacyNotes.size() + legacyTrash.size();
+    emit migrationProgress(0, notesTotal);
+
+    if(!legacyNotes.isEmpty())
+        migrateLegacyNotes(legacyNotes, false, 0, notesTotal);
+    if(!legacyTrash.isEmpty())
+        migrateLegacyNotes(legacyTrash, true, legacyNotes.size(), notesTotal);
+
+    if(QFile::exists(oldNoteDBPath))
+        QFile::rename(oldNoteDBPath, dir.path() + QDir::separator() + QStringLiteral("oldNotes.ini"));
     if(QFile::exists(oldTrashDBPath))
-        migrateTrash(oldTrashDBPath);
+        QFile::rename(oldTrashDBPath, dir.path() + QDir::separator() + QStringLiteral("oldTrash.ini"));
 
     emit requestForceLastRowIndexValue(m_noteCounter);
 }
 
 /*!
- * \brief MainWindow::migrateNote
- * \param notePath
+ * \brief MainWindow::readLegacyNotes
+ * Read the notes of a legacy ini file in a single pass over its groups,
+ * keeping their fields as raw strings
+ * \param iniPath
+ * \return
  */
-void MainWindow::migrateNote(QString notePath)
+QVector<MainWindow::LegacyNote> MainWindow::readLegacyNotes(const QString& iniPath)
 {
-    QSettings notesIni(notePath, QSettings::IniFormat);
-    QStringList dbKeys = notesIni.allKeys();
+    QSettings notesIni(iniPath, QSettings::IniFormat);
+    QStringList noteNames = notesIni.childGroups();
 
-    m_noteCounter = notesIni.value(QStringLiteral("notesCounter"), "0").toInt();
-    QList<NoteData *> noteList;
+    QVector<LegacyNote> legacyNotes;
+    legacyNotes.reserve(noteNames.size());
 
-    auto it = dbKeys.begin();
-    for(; it < dbKeys.end()-1; it += 3){
-        QString noteName = it->split(QStringLiteral("/"))[0];
-        int id = noteName.split(QStringLiteral("_"))[1].toInt();
+    for(const QString& noteName : noteNames){
+        int separator = noteName.indexOf(QLatin1Char('_'));
+        if(separator < 0)
+            continue;
 
-        // sync db index with biggest notes id
-        m_noteCounter = m_noteCounter < id ? id : m_noteCounter;
+        LegacyNote legacyNote;
+        legacyNote.id = noteName.midRef(separator + 1).toInt();
 
-        NoteData* newNote = new NoteData();
-        newNote->setId(id);
+        notesIni.beginGroup(noteName);
+        legacyNote.dateCreated = notesIni.value(QStringLiteral("dateCreated"), "Error").toString();
+        legacyNote.dateEdited = notesIni.value(QStringLiteral("dateEdited"), "Error").toString();
+        legacyNote.content = notesIni.value(QStringLiteral("content"), "Error").toString();
+        notesIni.endGroup();
 
-        QString createdDateDB = notesIni.value(noteName + QStringLiteral("/dateCreated"), "Error").toString();
-        newNote->setCreationDateTime(QDateTime::fromString(createdDateDB, Qt::ISODate));
-        QString lastEditedDateDB = notesIni.value(noteName + QStringLiteral("/dateEdited"), "Error").toString();
-        newNote->setLastModificationDateTime(QDateTime::fromString(lastEditedDateDB, Qt::ISODate));
-        QString contentText = notesIni.value(noteName + QStringLiteral("/content"), "Error").toString();
-        newNote->setContent(contentText);
-        QString firstLine = getFirstLine(contentText);
-        newNote->setFullTitle(firstLine);
+        // sync db index with biggest notes id
+        m_noteCounter = m_noteCounter < legacyNote.id ? legacyNote.id : m_noteCounter;
 
-        noteList.append(newNote);
+        legacyNotes.append(legacyNote);
     }
 
-    if(!noteList.isEmpty())
-        emit requestMigrateNotes(noteList);
-
-    QFile oldNoteDBFile(notePath);
-    oldNoteDBFile.rename(QFileInfo(notePath).dir().path() + QDir::separator() + QStringLiteral("oldNotes.ini"));
+    return legacyNotes;
 }
 
 /*!
- * \brief MainWindow::migrateTrash
- * \param trashPath
+ * \brief MainWindow::noteFromLegacyNote
+ * \param legacyNote
+ * \return
  */
-void MainWindow::migrateTrash(QString trashPath)
+NoteData* MainWindow::noteFromLegacyNote(const LegacyNote& legacyNote)
 {
-    QSettings trashIni(trashPath, QSettings::IniFormat);
-    QStringList dbKeys = trashIni.allKeys();
-
-    QList<NoteData *> noteList;
+    NoteData* newNote = new NoteData();
+    newNote->setId(legacyNote.id);
+    newNote->setCreationDateTime(QDateTime::fromString(legacyNote.dateCreated, Qt::ISODate));
+    newNote->setLastModificationDateTime(QDateTime::fromString(legacyNote.dateEdited, Qt::ISODate));
+    newNote->setContent(legacyNote.content);
+    newNote->setFullTitle(getFirstLine(legacyNote.content));
 
-    auto it = dbKeys.begin();
-    for(; it < dbKeys.end()-1; it += 3){
-        QString noteName = it->split(QStringLiteral("/"))[0];
-        int id = noteName.split(QStringLiteral("_"))[1].toInt();
+    return newNote;
+}
 
-        // sync db index with biggest notes id
-        m_noteCounter = m_noteCounter < id ? id : m_noteCounter;
+/*!
+ * \brief MainWindow::migrateLegacyNotes
+ * Build the notes MIGRATION_BATCH_SIZE at a time across the thread pool.
+ * The next batch is built while the database writes the current one
+ * \param legacyNotes
+ * \param isTrash
+ * \param notesMigrated notes already migrated before this call
+ * \param notesTotal
+ */
+void MainWindow::migrateLegacyNotes(const QVector<LegacyNote>& legacyNotes, bool isTrash,
+                                    int notesMigrated, int notesTotal)
+{
+    auto buildBatch = [&legacyNotes](int first){
+        QVector<LegacyNote>::const_iterator begin = legacyNotes.constBegin() + first;
+        QVector<LegacyNote>::const_iterator end = legacyNotes.constBegin()
+                + qMin(first + MIGRATION_BATCH_SIZE, legacyNotes.size());
+        return QtConcurrent::mapped(begin, end, &MainWindow::noteFromLegacyNote);
+    };
 
-        NoteData* newNote = new NoteData();
-        newNote->setId(id);
+    QFuture<NoteData*> batch = buildBatch(0);
+    for(int first = 0; first < legacyNotes.size(); first += MIGRATION_BATCH_SIZE){
+        QList<NoteData*> noteList = batch.results();
+        if(first + MIGRATION_BATCH_SIZE < legacyNotes.size())
+            batch = buildBatch(first + MIGRATION_BATCH_SIZE);
 
-        QString createdDateDB = trashIni.value(noteName + QStringLiteral("/dateCreated"), "Error").toString();
-        newNote->setCreationDateTime(QDateTime::fromString(createdDateDB, Qt::ISODate));
-        QString lastEditedDateDB = trashIni.value(noteName + QStringLiteral("/dateEdited"), "Error").toString();
-        newNote->setLastModificationDateTime(QDateTime::fromString(lastEditedDateDB, Qt::ISODate));
-        QString contentText = trashIni.value(noteName + QStringLiteral("/content"), "Error").toString();
-        newNote->setContent(contentText);
-        QString firstLine = getFirstLine(contentText);
-        newNote->setFullTitle(firstLine);
+        if(isTrash)
+            emit requestMigrateTrash(noteList);
+        else
+            emit requestMigrateNotes(noteList);
 
-        noteList.append(newNote);
+        notesMigrated += noteList.size();
+        emit migrationProgress(notesMigrated, notesTotal);
     }
-
-    if(!noteList.isEmpty())
-        emit requestMigrateTrash(noteList);
-
-    QFile oldTrashDBFile(trashPath);
-    oldTrashDBFile.rename(QFileInfo(trashPath).dir().path() + QDir::separator() + QStringLiteral("oldTrash.ini"));
 }
 
 /*!
@@ -29,8 +29,10 @@
 #include "notedata.h"
 #include "notemodel.h"
 #include "noteview.h"
+#include "notefilterproxymodel.h"
 #include "updaterwindow.h"
 #include "dbmanager.h"
+#include "editjournal.h"
 #include "markdownhighlighter.h"
 
 namespace Ui {
@@ -121,12 +123,21 @@ private:
     NoteView* m_noteView;
     NoteModel* m_noteModel;
     NoteModel* m_deletedNotesModel;
-    QSortFilterProxyModel* m_proxyModel;
+    NoteFilterProxyModel* m_proxyModel;
     QModelIndex m_currentSelectedNoteProxy;
     QModelIndex m_selectedNoteBeforeSearchingInSource;
     QQueue<QString> m_searchQueue;
     DBManager* m_dbManager;
+    struct LegacyNote{
+        int id;
+        QString dateCreated;
+        QString dateEdited;
+        QString content;
+    };
+
     QThread* m_dbThread;
+    QProgressDialog* m_jobProgressDialog;
+    EditJournal* m_editJournal;
     MarkdownHighlighter *m_highlighter;
 
     UpdaterWindow m_updater;
@@ -148,6 +159,8 @@ private:
     bool m_dontShowUpdateWindow;
     bool m_alwaysStayOnTop;
     bool m_useNativeWindowFrame;
+    bool m_reloadNotesAfterJob;
+    QString m_importSummary;
 
     void setupMainWindow();
     void setupFonts();
@@ -169,10 +182,9 @@ private:
     void setLayoutForScrollArea();
     void setButtonsAndFieldsEnabled(bool doEnable);
     void restoreStates();
-    QString getFirstLine(const QString& str);
-    QString getNoteDateEditor (QString dateEdited);
+    static QString getFirstLine(const QString& str);
+    QString getNoteDateEditor (qint64 dateEdited);
     NoteData* generateNote(const int noteID);
-    QDateTime getQDateTime(QString date);
     void showNoteInEditor(const QModelIndex& noteIndex);
     void sortNotesList(QStringList &stringNotesList);
     void saveNoteToDB(const QModelIndex& noteIndex);
@@ -184,9 +196,13 @@ private:
     void findNotesContain(const QString &keyword);
     void selectNote(const QModelIndex& noteIndex);
     void checkMigration();
+    void replayEditJournal();
     void executeImport(const bool replace);
-    void migrateNote(QString notePath);
-    void migrateTrash(QString trashPath);
+    void startJob(const QString& label, bool reloadNotesAfter);
+    QVector<LegacyNote> readLegacyNotes(const QString& iniPath);
+    void migrateLegacyNotes(const QVector<LegacyNote>& legacyNotes, bool isTrash,
+                            int notesMigrated, int notesTotal);
+    static NoteData* noteFromLegacyNote(const LegacyNote& legacyNote);
 
     void dropShadow(QPainter& painter, ShadowType type, ShadowSide side);
     void fillRectWithGradient(QPainter& painter, const QRect& rect, QGradient& gradient);
@@ -196,7 +212,8 @@ private:
 
 private slots:
     void InitData();
-    void loadNotes(QList<NoteData *> noteList, int noteCounter);
+    void loadNotes(QList<NoteData *> noteList, int noteCounter, bool isLastPage);
+    void onSearchFinished(QString keyword, QList<int> noteIdList);
     void onNewNoteButtonPressed();
     void onNewNoteButtonClicked();
     void onTrashButtonPressed();
@@ -236,18 +253,26 @@ private slots:
     void setUseNativeWindowFrame(bool useNativeWindowFrame);
     void toggleStayOnTop();
     void onSearchEditReturnPressed();
+    void onJobProgress(qint64 notesProcessed, qint64 notesTotal,
+                       qint64 bytesProcessed, qint64 bytesTotal, double notesPerSecond);
+    void onJobFinished(bool isCompleted);
+    void onImportFinished(int notesInserted, int notesSkipped, int notesMerged);
+    void onNotesImported(QList<NoteData *> noteList);
 
 signals:
     void requestNotesList();
-    void requestOpenDBManager(QString path, bool doCreate);
+    void requestOpenDBManager(QString path);
     void requestCreateUpdateNote(NoteData* note);
+    void requestFlushPendingSaves();
     void requestDeleteNote(NoteData* note);
-    void requestRestoreNotes(QList<NoteData *> noteList);
-    void requestImportNotes(QList<NoteData *> noteList);
+    void requestRestoreNotesFile(QString fileName);
+    void requestImportNotesFile(QString fileName);
     void requestExportNotes(QString fileName);
+    void requestSearch(QString keyword);
     void requestMigrateNotes(QList<NoteData *> noteList);
     void requestMigrateTrash(QList<NoteData *> noteList);
     void requestForceLastRowIndexValue(int index);
+    void migrationProgress(int notesMigrated, int notesTotal);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,280 @@
+#include "notebackup.h"
+#include <algorithm>
+
+#define NBK_MAGIC 0x4E424B32
+#define NBK_INDEX_MAGIC 0x4E424B49
+#define NBK_VERSION 2
+#define NBK_TRAILER_SIZE 12
+#define NBK_INDEX_ENTRY_SIZE 12
+#define NBK_COMPRESSION_THRESHOLD 1024
+
+enum RecordEncoding : quint8 {
+    Plain = 0,
+    Zlib
+};
+
+/*!
+ * \brief NoteBackupWriter::NoteBackupWriter
+ * \param device opened for writing
+ * \param compress compress the records of large notes
+ */
+NoteBackupWriter::NoteBackupWriter(QIODevice* device, bool compress)
+    : m_device(device),
+      m_stream(device),
+      m_compress(compress)
+{
+    m_stream.setVersion(QDataStream::Qt_5_2);
+    m_stream << quint32(NBK_MAGIC) << quint16(NBK_VERSION) << quint16(0);
+}
+
+/*!
+ * \brief NoteBackupWriter::writeNote
+ * \param note
+ * \return
+ */
+bool NoteBackupWriter::writeNote(const NoteData* note)
+{
+    QByteArray payload;
+    QDataStream record(&payload, QIODevice::WriteOnly);
+    record.setVersion(QDataStream::Qt_5_2);
+    record << qint32(note->id()) << note->fullTitle()
+           << note->creationDate()
+           << note->lastModificationDate()
+           << note->content();
+
+    quint8 encoding = RecordEncoding::Plain;
+    if(m_compress && payload.size() >= NBK_COMPRESSION_THRESHOLD){
+        QByteArray compressed = qCompress(payload);
+        if(compressed.size() < payload.size()){
+            payload = compressed;
+            encoding = RecordEncoding::Zlib;
+        }
+    }
+
+    m_index.append(qMakePair(qint32(note->id()), m_device->pos()));
+
+    m_stream << quint32(payload.size()) << encoding;
+    m_stream.writeRawData(payload.constData(), payload.size());
+
+    return m_stream.status() == QDataStream::Ok;
+}
+
+/*!
+ * \brief NoteBackupWriter::finish
+ * Write the index and the trailer pointing to it
+ * \return
+ */
+bool NoteBackupWriter::finish()
+{
+    std::sort(m_index.begin(), m_index.end());
+
+    qint64 indexOffset = m_device->pos();
+    for(const QPair<qint32, qint64>& entry : m_index)
+        m_stream << entry.first << entry.second;
+
+    m_stream << indexOffset << quint32(NBK_INDEX_MAGIC);
+
+    return m_stream.status() == QDataStream::Ok;
+}
+
+/*!
+ * \brief NoteBackupReader::NoteBackupReader
+ * \param device opened for reading
+ */
+NoteBackupReader::NoteBackupReader(QIODevice* device)
+    : m_device(device),
+      m_stream(device),
+      m_version(0),
+      m_noteCount(0),
+      m_notesRead(0),
+      m_dataOffset(0),
+      m_indexOffset(0)
+{
+    quint32 magic;
+    m_stream >> magic;
+    if(m_stream.status() != QDataStream::Ok)
+        return;
+
+    if(magic != NBK_MAGIC){
+        // a version 1 file is a single serialized QList<NoteData*>, it starts with the number of notes
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+        m_stream.setVersion(QDataStream::Qt_5_6);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+        m_stream.setVersion(QDataStream::Qt_5_4);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
+        m_stream.setVersion(QDataStream::Qt_5_2);
+#endif
+        m_version = 1;
+        m_noteCount = int(magic);
+        m_dataOffset = m_device->pos();
+        return;
+    }
+
+    quint16 version;
+    quint16 flags;
+    m_stream.setVersion(QDataStream::Qt_5_2);
+    m_stream >> version >> flags;
+    if(m_stream.status() != QDataStream::Ok || version != NBK_VERSION)
+        return;
+
+    m_version = version;
+    m_dataOffset = m_device->pos();
+    m_indexOffset = m_device->size();
+    m_noteCount = -1;
+
+    qint64 indexOffset;
+    quint32 indexMagic;
+    if(m_device->seek(m_device->size() - NBK_TRAILER_SIZE)){
+        m_stream >> indexOffset >> indexMagic;
+        // without its index, a file cut short is still read up to its last complete note
+        if(m_stream.status() == QDataStream::Ok && indexMagic == NBK_INDEX_MAGIC
+                && indexOffset >= m_dataOffset && indexOffset <= m_device->size() - NBK_TRAILER_SIZE){
+            m_indexOffset = indexOffset;
+            m_noteCount = int((m_device->size() - NBK_TRAILER_SIZE - indexOffset) / NBK_INDEX_ENTRY_SIZE);
+        }
+    }
+
+    m_stream.resetStatus();
+    m_device->seek(m_dataOffset);
+}
+
+/*!
+ * \brief NoteBackupReader::version
+ * \return the version of the file format, 0 if the device doesn't hold a notes backup
+ */
+int NoteBackupReader::version() const
+{
+    return m_version;
+}
+
+/*!
+ * \brief NoteBackupReader::noteCount
+ * \return the number of notes in the file, -1 if a version 2 file has lost its index
+ */
+int NoteBackupReader::noteCount() const
+{
+    return m_noteCount;
+}
+
+/*!
+ * \brief NoteBackupReader::readNext
+ * \param parent
+ * \return the next note of the file, null after the last one or on a corrupted record
+ */
+NoteData* NoteBackupReader::readNext(QObject* parent)
+{
+    if(m_version == 1){
+        if(m_notesRead >= m_noteCount)
+            return Q_NULLPTR;
+
+        NoteData* note = Q_NULLPTR;
+        m_stream >> note;
+        if(m_stream.status() != QDataStream::Ok){
+            delete note;
+            return Q_NULLPTR;
+        }
+
+        ++m_notesRead;
+        note->setParent(parent);
+        return note;
+    }
+
+    if(m_version == 2 && m_device->pos() < m_indexOffset)
+        return readRecord(parent);
+
+    return Q_NULLPTR;
+}
+
+/*!
+ * \brief NoteBackupReader::readNote
+ * Look the note up in the index of a version 2 file, the notes of a version 1 file
+ * are read until it is found. Reading goes on after this note with readNext
+ * \param id
+ * \param parent
+ * \return the note 'id', null if the file doesn't have it
+ */
+NoteData* NoteBackupReader::readNote(int id, QObject* parent)
+{
+    if(m_version == 2 && m_noteCount > 0){
+        int first = 0;
+        int last = m_noteCount - 1;
+        while(first <= last){
+            int middle = first + (last - first) / 2;
+            qint32 entryId;
+            qint64 entryOffset;
+            m_device->seek(m_indexOffset + qint64(middle) * NBK_INDEX_ENTRY_SIZE);
+            m_stream >> entryId >> entryOffset;
+            if(m_stream.status() != QDataStream::Ok)
+                return Q_NULLPTR;
+
+            if(entryId == id){
+                m_device->seek(entryOffset);
+                return readRecord(parent);
+            }
+
+            if(entryId < id)
+                first = middle + 1;
+            else
+                last = middle - 1;
+        }
+        return Q_NULLPTR;
+    }
+
+    if(m_version == 1){
+        m_device->seek(m_dataOffset);
+        m_stream.resetStatus();
+        m_notesRead = 0;
+    }
+
+    while(NoteData* note = readNext()){
+        if(note->id() == id){
+            note->setParent(parent);
+            return note;
+        }
+        delete note;
+    }
+    return Q_NULLPTR;
+}
+
+/*!
+ * \brief NoteBackupReader::readRecord
+ * \param parent
+ * \return the note stored in the record at the current position
+ */
+NoteData* NoteBackupReader::readRecord(QObject* parent)
+{
+    quint32 size;
+    quint8 encoding;
+    m_stream >> size >> encoding;
+    qint64 available = m_indexOffset - m_device->pos();
+    if(m_stream.status() != QDataStream::Ok || available < 0 || qint64(size) > available)
+        return Q_NULLPTR;
+
+    QByteArray payload(int(size), Qt::Uninitialized);
+    if(m_stream.readRawData(payload.data(), int(size)) != int(size))
+        return Q_NULLPTR;
+
+    if(encoding == RecordEncoding::Zlib)
+        payload = qUncompress(payload);
+    else if(encoding != RecordEncoding::Plain)
+        return Q_NULLPTR;
+
+    qint32 id;
+    QString fullTitle;
+    qint64 creationDate;
+    qint64 modificationDate;
+    QString content;
+    QDataStream record(payload);
+    record.setVersion(QDataStream::Qt_5_2);
+    record >> id >> fullTitle >> creationDate >> modificationDate >> content;
+    if(record.status() != QDataStream::Ok)
+        return Q_NULLPTR;
+
+    NoteData* note = new NoteData(parent);
+    note->setId(id);
+    note->setFullTitle(fullTitle);
+    note->setCreationDate(creationDate);
+    note->setLastModificationDate(modificationDate);
+    note->setContent(content);
+    return note;
+}
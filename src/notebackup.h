@@ -0,0 +1,60 @@
+#ifndef NOTEBACKUP_H
+#define NOTEBACKUP_H
+
+#include "notedata.h"
+#include <QDataStream>
+#include <QIODevice>
+#include <QPair>
+#include <QVector>
+
+/*!
+ * \brief The NoteBackupWriter class
+ * Writes a .nbk version 2 file note by note: a header,
+ * one length-prefixed and optionally compressed record per note,
+ * then an index of the records sorted by note id
+ */
+class NoteBackupWriter
+{
+public:
+    explicit NoteBackupWriter(QIODevice* device, bool compress = true);
+
+    bool writeNote(const NoteData* note);
+    bool finish();
+
+private:
+    QIODevice* m_device;
+    QDataStream m_stream;
+    bool m_compress;
+    QVector<QPair<qint32, qint64> > m_index;
+};
+
+/*!
+ * \brief The NoteBackupReader class
+ * Reads the notes of a .nbk file one at a time, whatever its version.
+ * In a version 2 file a single note can be read through the index
+ * without going over the others
+ */
+class NoteBackupReader
+{
+public:
+    explicit NoteBackupReader(QIODevice* device);
+
+    int version() const;
+    int noteCount() const;
+
+    NoteData* readNext(QObject* parent = Q_NULLPTR);
+    NoteData* readNote(int id, QObject* parent = Q_NULLPTR);
+
+private:
+    QIODevice* m_device;
+    QDataStream m_stream;
+    int m_version;
+    int m_noteCount;
+    int m_notesRead;
+    qint64 m_dataOffset;
+    qint64 m_indexOffset;
+
+    NoteData* readRecord(QObject* parent);
+};
+
+#endif // NOTEBACKUP_H
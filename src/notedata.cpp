@@ -1,8 +1,32 @@
 #include "notedata.h"
 #include <QDataStream>
 
+/*!
+ * \brief toEpoch
+ * \param dateTime
+ * \return the milliseconds since epoch, -1 for an invalid date
+ */
+static qint64 toEpoch(const QDateTime& dateTime)
+{
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : -1;
+}
+
+/*!
+ * \brief fromEpoch
+ * \param epoch
+ * \return
+ */
+static QDateTime fromEpoch(qint64 epoch)
+{
+    return epoch == -1 ? QDateTime() : QDateTime::fromMSecsSinceEpoch(epoch);
+}
+
 NoteData::NoteData(QObject *parent)
     : QObject(parent),
+      m_lastModificationDate(-1),
+      m_creationDate(-1),
+      m_deletionDate(-1),
+      m_isContentLoaded(true),
       m_isModified(false),
       m_isSelected(false),
       m_scrollBarPosition(0)
@@ -10,6 +34,22 @@ NoteData::NoteData(QObject *parent)
 
 }
 
+NoteData* NoteData::clone(QObject *parent) const
+{
+    NoteData* note = new NoteData(parent);
+    note->m_id = m_id;
+    note->m_fullTitle = m_fullTitle;
+    note->m_lastModificationDate = m_lastModificationDate;
+    note->m_creationDate = m_creationDate;
+    note->m_deletionDate = m_deletionDate;
+    note->m_content = m_content;
+    note->m_isContentLoaded = m_isContentLoaded;
+    note->m_isModified = m_isModified;
+    note->m_isSelected = m_isSelected;
+    note->m_scrollBarPosition = m_scrollBarPosition;
+    return note;
+}
+
 int NoteData::id() const
 {
     return m_id;
@@ -32,12 +72,22 @@ void NoteData::setFullTitle(const QString &fullTitle)
 
 QDateTime NoteData::lastModificationdateTime() const
 {
-    return m_lastModificationDateTime;
+    return fromEpoch(m_lastModificationDate);
 }
 
 void NoteData::setLastModificationDateTime(const QDateTime &lastModificationdateTime)
 {
-    m_lastModificationDateTime = lastModificationdateTime;
+    m_lastModificationDate = toEpoch(lastModificationdateTime);
+}
+
+qint64 NoteData::lastModificationDate() const
+{
+    return m_lastModificationDate;
+}
+
+void NoteData::setLastModificationDate(qint64 lastModificationDate)
+{
+    m_lastModificationDate = lastModificationDate;
 }
 
 QString NoteData::content() const
@@ -50,6 +100,16 @@ void NoteData::setContent(const QString &content)
     m_content = content;
 }
 
+bool NoteData::isContentLoaded() const
+{
+    return m_isContentLoaded;
+}
+
+void NoteData::setContentLoaded(bool isContentLoaded)
+{
+    m_isContentLoaded = isContentLoaded;
+}
+
 bool NoteData::isModified() const
 {
     return m_isModified;
@@ -82,22 +142,42 @@ void NoteData::setScrollBarPosition(int scrollBarPosition)
 
 QDateTime NoteData::deletionDateTime() const
 {
-    return m_deletionDateTime;
+    return fromEpoch(m_deletionDate);
 }
 
 void NoteData::setDeletionDateTime(const QDateTime& deletionDateTime)
 {
-    m_deletionDateTime = deletionDateTime;
+    m_deletionDate = toEpoch(deletionDateTime);
+}
+
+qint64 NoteData::deletionDate() const
+{
+    return m_deletionDate;
+}
+
+void NoteData::setDeletionDate(qint64 deletionDate)
+{
+    m_deletionDate = deletionDate;
 }
 
 QDateTime NoteData::creationDateTime() const
 {
-    return m_creationDateTime;
+    return fromEpoch(m_creationDate);
 }
 
 void NoteData::setCreationDateTime(const QDateTime&creationDateTime)
 {
-    m_creationDateTime = creationDateTime;
+    m_creationDate = toEpoch(creationDateTime);
+}
+
+qint64 NoteData::creationDate() const
+{
+    return m_creationDate;
+}
+
+void NoteData::setCreationDate(qint64 creationDate)
+{
+    m_creationDate = creationDate;
 }
 
 QDataStream &operator<<(QDataStream &stream, const NoteData* noteData) {
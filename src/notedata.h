@@ -13,6 +13,8 @@ class NoteData : public QObject
 public:
     explicit NoteData(QObject *parent = Q_NULLPTR);
 
+    NoteData* clone(QObject *parent = Q_NULLPTR) const;
+
     int id() const;
     void setId(const int& id);
 
@@ -21,13 +23,20 @@ public:
 
     QDateTime lastModificationdateTime() const;
     void setLastModificationDateTime(const QDateTime &lastModificationdateTime);
+    qint64 lastModificationDate() const;
+    void setLastModificationDate(qint64 lastModificationDate);
 
     QDateTime creationDateTime() const;
     void setCreationDateTime(const QDateTime& creationDateTime);
+    qint64 creationDate() const;
+    void setCreationDate(qint64 creationDate);
 
     QString content() const;
     void setContent(const QString &content);
 
+    bool isContentLoaded() const;
+    void setContentLoaded(bool isContentLoaded);
+
     bool isModified() const;
     void setModified(bool isModified);
 
@@ -39,15 +48,19 @@ public:
 
     QDateTime deletionDateTime() const;
     void setDeletionDateTime(const QDateTime& deletionDateTime);
+    qint64 deletionDate() const;
+    void setDeletionDate(qint64 deletionDate);
 
 
 private:
     int m_id;
     QString m_fullTitle;
-    QDateTime m_lastModificationDateTime;
-    QDateTime m_creationDateTime;
-    QDateTime m_deletionDateTime;
+    // milliseconds since epoch, -1 when not set
+    qint64 m_lastModificationDate;
+    qint64 m_creationDate;
+    qint64 m_deletionDate;
     QString m_content;
+    bool m_isContentLoaded;
     bool m_isModified;
     bool m_isSelected;
     int m_scrollBarPosition;
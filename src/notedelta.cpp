@@ -0,0 +1,61 @@
+#include "notedelta.h"
+#include <QDataStream>
+
+/*!
+ * \brief NoteDelta::encode
+ * \param base
+ * \param target
+ * \return the delta turning 'base' into 'target'
+ */
+QByteArray NoteDelta::encode(const QString& base, const QString& target)
+{
+    int maxCommon = qMin(base.size(), target.size());
+
+    int prefix = 0;
+    while(prefix < maxCommon && base.at(prefix) == target.at(prefix))
+        ++prefix;
+    // don't cut a surrogate pair in two
+    if(prefix > 0 && base.at(prefix - 1).isHighSurrogate())
+        --prefix;
+
+    int suffix = 0;
+    while(suffix < maxCommon - prefix
+          && base.at(base.size() - 1 - suffix) == target.at(target.size() - 1 - suffix))
+        ++suffix;
+    if(suffix > 0 && target.at(target.size() - suffix).isLowSurrogate())
+        --suffix;
+
+    QByteArray delta;
+    QDataStream stream(&delta, QIODevice::WriteOnly);
+    stream << quint32(prefix) << quint32(suffix)
+           << target.mid(prefix, target.size() - prefix - suffix).toUtf8();
+
+    return delta;
+}
+
+/*!
+ * \brief NoteDelta::apply
+ * \param base
+ * \param delta
+ * \param ok set to false if the delta doesn't apply to 'base'
+ * \return the version of the note 'delta' was encoded for
+ */
+QString NoteDelta::apply(const QString& base, const QByteArray& delta, bool* ok)
+{
+    QDataStream stream(delta);
+    quint32 prefix = 0;
+    quint32 suffix = 0;
+    QByteArray replacement;
+    stream >> prefix >> suffix >> replacement;
+
+    bool isValid = stream.status() == QDataStream::Ok
+            && quint64(prefix) + quint64(suffix) <= quint64(base.size());
+    if(ok != Q_NULLPTR)
+        *ok = isValid;
+    if(!isValid)
+        return QString();
+
+    QString target = base;
+    target.replace(int(prefix), base.size() - int(prefix) - int(suffix), QString::fromUtf8(replacement));
+    return target;
+}
@@ -0,0 +1,22 @@
+#ifndef NOTEDELTA_H
+#define NOTEDELTA_H
+
+#include <QString>
+#include <QByteArray>
+
+/*!
+ * \brief The NoteDelta class
+ * Encodes a version of a note as the difference from the previous one:
+ * the length of the text both versions start and end with,
+ * and the text replaced in between.
+ * Edits are usually made at one place between two saves,
+ * so the delta is about the size of the edit whatever the size of the note
+ */
+class NoteDelta
+{
+public:
+    static QByteArray encode(const QString& base, const QString& target);
+    static QString apply(const QString& base, const QByteArray& delta, bool* ok = Q_NULLPTR);
+};
+
+#endif // NOTEDELTA_H
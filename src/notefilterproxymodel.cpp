@@ -0,0 +1,473 @@
+#include "notefilterproxymodel.h"
+#include "notemodel.h"
+#include <algorithm>
+
+#define SOURCE_ROWS_MAX_RUNS 64
+
+NoteFilterProxyModel::NoteFilterProxyModel(QObject *parent)
+    : QAbstractProxyModel(parent),
+      m_isFiltering(false),
+      m_movedFirst(0),
+      m_movedLast(-1),
+      m_movedDestination(0),
+      m_isMoveReported(false)
+{
+
+}
+
+/*!
+ * \brief NoteFilterProxyModel::setSourceModel
+ * \param sourceModel
+ */
+void NoteFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    beginResetModel();
+
+    if(this->sourceModel() != Q_NULLPTR)
+        disconnect(this->sourceModel(), Q_NULLPTR, this, Q_NULLPTR);
+
+    QAbstractProxyModel::setSourceModel(sourceModel);
+
+    if(sourceModel != Q_NULLPTR){
+        connect(sourceModel, &QAbstractItemModel::rowsInserted,
+                this, &NoteFilterProxyModel::onSourceRowsInserted);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved,
+                this, &NoteFilterProxyModel::onSourceRowsAboutToBeRemoved);
+        connect(sourceModel, &QAbstractItemModel::rowsRemoved,
+                this, &NoteFilterProxyModel::onSourceRowsRemoved);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeMoved,
+                this, &NoteFilterProxyModel::onSourceRowsAboutToBeMoved);
+        connect(sourceModel, &QAbstractItemModel::rowsMoved,
+                this, &NoteFilterProxyModel::onSourceRowsMoved);
+        connect(sourceModel, &QAbstractItemModel::dataChanged,
+                this, &NoteFilterProxyModel::onSourceDataChanged);
+        connect(sourceModel, &QAbstractItemModel::layoutAboutToBeChanged,
+                this, &NoteFilterProxyModel::onSourceLayoutAboutToBeChanged);
+        connect(sourceModel, &QAbstractItemModel::layoutChanged,
+                this, &NoteFilterProxyModel::onSourceLayoutChanged);
+        connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset,
+                this, &NoteFilterProxyModel::onSourceModelAboutToBeReset);
+        connect(sourceModel, &QAbstractItemModel::modelReset,
+                this, &NoteFilterProxyModel::onSourceModelReset);
+    }
+
+    m_sourceRows = acceptedRows();
+    endResetModel();
+}
+
+/*!
+ * \brief NoteFilterProxyModel::setNoteIdFilter
+ * Only show the notes whose id is in 'noteIdList'.
+ * When every id was already accepted, as with a keyword growing while it is typed,
+ * only the notes shown are tested again. Otherwise every note of the source is tested
+ * \param noteIdList
+ */
+void NoteFilterProxyModel::setNoteIdFilter(const QList<int>& noteIdList)
+{
+    QSet<int> acceptedNoteIds;
+    acceptedNoteIds.reserve(noteIdList.size());
+    bool isRefinement = m_isFiltering;
+    for(int noteId : noteIdList){
+        acceptedNoteIds.insert(noteId);
+        isRefinement = isRefinement && m_acceptedNoteIds.contains(noteId);
+    }
+
+    m_acceptedNoteIds.swap(acceptedNoteIds);
+    m_isFiltering = true;
+
+    if(isRefinement){
+        QVector<int> sourceRows;
+        sourceRows.reserve(m_sourceRows.size());
+        for(int sourceRow : m_sourceRows){
+            if(acceptsRow(sourceRow))
+                sourceRows.append(sourceRow);
+        }
+        setSourceRows(sourceRows);
+    }else{
+        setSourceRows(acceptedRows());
+    }
+}
+
+/*!
+ * \brief NoteFilterProxyModel::clearNoteIdFilter
+ * Show every note again
+ */
+void NoteFilterProxyModel::clearNoteIdFilter()
+{
+    m_acceptedNoteIds.clear();
+    m_isFiltering = false;
+    setSourceRows(acceptedRows());
+}
+
+bool NoteFilterProxyModel::isFiltering() const
+{
+    return m_isFiltering;
+}
+
+QModelIndex NoteFilterProxyModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if(parent.isValid() || row < 0 || row >= m_sourceRows.size() || column < 0 || column >= columnCount())
+        return QModelIndex();
+
+    return createIndex(row, column);
+}
+
+QModelIndex NoteFilterProxyModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child)
+
+    return QModelIndex();
+}
+
+int NoteFilterProxyModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_sourceRows.size();
+}
+
+int NoteFilterProxyModel::columnCount(const QModelIndex &parent) const
+{
+    if(parent.isValid() || sourceModel() == Q_NULLPTR)
+        return 0;
+
+    return sourceModel()->columnCount();
+}
+
+bool NoteFilterProxyModel::hasChildren(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !m_sourceRows.isEmpty();
+}
+
+QModelIndex NoteFilterProxyModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if(!proxyIndex.isValid() || sourceModel() == Q_NULLPTR || proxyIndex.row() >= m_sourceRows.size())
+        return QModelIndex();
+
+    return sourceModel()->index(m_sourceRows.at(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex NoteFilterProxyModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if(!sourceIndex.isValid())
+        return QModelIndex();
+
+    int row = proxyRow(sourceIndex.row());
+    if(row == m_sourceRows.size() || m_sourceRows.at(row) != sourceIndex.row())
+        return QModelIndex();
+
+    return createIndex(row, sourceIndex.column());
+}
+
+/*!
+ * \brief NoteFilterProxyModel::acceptsRow
+ * \param sourceRow
+ * \return
+ */
+bool NoteFilterProxyModel::acceptsRow(int sourceRow) const
+{
+    if(!m_isFiltering)
+        return true;
+
+    QModelIndex index = sourceModel()->index(sourceRow, 0);
+    return m_acceptedNoteIds.contains(index.data(NoteModel::NoteID).toInt());
+}
+
+/*!
+ * \brief NoteFilterProxyModel::acceptedRows
+ * Test every row of the source model
+ * \return the source rows to show
+ */
+QVector<int> NoteFilterProxyModel::acceptedRows() const
+{
+    QVector<int> sourceRows;
+    if(sourceModel() == Q_NULLPTR)
+        return sourceRows;
+
+    int sourceRowCount = sourceModel()->rowCount();
+    sourceRows.reserve(m_isFiltering ? qMin(m_acceptedNoteIds.size(), sourceRowCount) : sourceRowCount);
+    for(int sourceRow = 0; sourceRow < sourceRowCount; ++sourceRow){
+        if(acceptsRow(sourceRow))
+            sourceRows.append(sourceRow);
+    }
+    return sourceRows;
+}
+
+/*!
+ * \brief NoteFilterProxyModel::proxyRow
+ * \param sourceRow
+ * \return the first proxy row showing 'sourceRow' or a source row after it
+ */
+int NoteFilterProxyModel::proxyRow(int sourceRow) const
+{
+    return int(std::lower_bound(m_sourceRows.constBegin(), m_sourceRows.constEnd(), sourceRow)
+               - m_sourceRows.constBegin());
+}
+
+/*!
+ * \brief NoteFilterProxyModel::setSourceRows
+ * Show 'sourceRows' instead of the rows shown now. The rows hidden are removed,
+ * then the rows shown are inserted, with one signal per run of adjacent rows.
+ * Past SOURCE_ROWS_MAX_RUNS runs, each of them shifting the rows after it,
+ * the proxy is reset instead
+ * \param sourceRows sorted
+ */
+void NoteFilterProxyModel::setSourceRows(const QVector<int>& sourceRows)
+{
+    QVector<bool> isKept(m_sourceRows.size(), false);
+    int runCount = 0;
+    int next = 0;
+    for(int row = 0; row < m_sourceRows.size(); ++row){
+        int previous = next;
+        while(next < sourceRows.size() && sourceRows.at(next) < m_sourceRows.at(row))
+            ++next;
+        isKept[row] = next < sourceRows.size() && sourceRows.at(next) == m_sourceRows.at(row);
+
+        if(next > previous)
+            ++runCount;
+        if(!isKept.at(row) && (row == 0 || isKept.at(row - 1)))
+            ++runCount;
+        if(isKept.at(row))
+            ++next;
+    }
+    if(next < sourceRows.size())
+        ++runCount;
+
+    if(runCount > SOURCE_ROWS_MAX_RUNS){
+        beginResetModel();
+        m_sourceRows = sourceRows;
+        endResetModel();
+        return;
+    }
+
+    // removed from the last run up, the rows above a run keep their position
+    int last = m_sourceRows.size() - 1;
+    while(last >= 0){
+        if(isKept.at(last)){
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while(first > 0 && !isKept.at(first - 1))
+            --first;
+
+        beginRemoveRows(QModelIndex(), first, last);
+        m_sourceRows.remove(first, last - first + 1);
+        endRemoveRows();
+        last = first - 1;
+    }
+
+    // the rows left are all in 'sourceRows', the others go between them
+    int added = 0;
+    int row = 0;
+    while(added < sourceRows.size()){
+        if(row < m_sourceRows.size() && m_sourceRows.at(row) == sourceRows.at(added)){
+            ++row;
+            ++added;
+            continue;
+        }
+
+        int first = added;
+        while(added < sourceRows.size() && (row == m_sourceRows.size() || sourceRows.at(added) != m_sourceRows.at(row)))
+            ++added;
+
+        beginInsertRows(QModelIndex(), row, row + added - first - 1);
+        m_sourceRows.insert(row, added - first, 0);
+        std::copy(sourceRows.constBegin() + first, sourceRows.constBegin() + added, m_sourceRows.begin() + row);
+        endInsertRows();
+        row += added - first;
+    }
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceRowsInserted
+ * The rows after the new ones move down, the new ones accepted are shown
+ * \param parent
+ * \param first
+ * \param last
+ */
+void NoteFilterProxyModel::onSourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    int row = proxyRow(first);
+    int count = last - first + 1;
+    for(int i = row; i < m_sourceRows.size(); ++i)
+        m_sourceRows[i] += count;
+
+    QVector<int> insertedRows;
+    for(int sourceRow = first; sourceRow <= last; ++sourceRow){
+        if(acceptsRow(sourceRow))
+            insertedRows.append(sourceRow);
+    }
+    if(insertedRows.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), row, row + insertedRows.size() - 1);
+    m_sourceRows.insert(row, insertedRows.size(), 0);
+    std::copy(insertedRows.constBegin(), insertedRows.constEnd(), m_sourceRows.begin() + row);
+    endInsertRows();
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceRowsAboutToBeRemoved
+ * \param parent
+ * \param first
+ * \param last
+ */
+void NoteFilterProxyModel::onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    int firstRow = proxyRow(first);
+    int lastRow = proxyRow(last + 1) - 1;
+    if(firstRow > lastRow)
+        return;
+
+    beginRemoveRows(QModelIndex(), firstRow, lastRow);
+    m_sourceRows.remove(firstRow, lastRow - firstRow + 1);
+    endRemoveRows();
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceRowsRemoved
+ * The rows after the removed ones move up
+ * \param parent
+ * \param first
+ * \param last
+ */
+void NoteFilterProxyModel::onSourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent)
+
+    int count = last - first + 1;
+    for(int i = proxyRow(first); i < m_sourceRows.size(); ++i)
+        m_sourceRows[i] -= count;
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceRowsAboutToBeMoved
+ * The rows shown among the moved ones are moved in the proxy as well
+ * \param sourceParent
+ * \param sourceStart
+ * \param sourceEnd
+ * \param destinationParent
+ * \param destinationRow
+ */
+void NoteFilterProxyModel::onSourceRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                                      const QModelIndex &destinationParent, int destinationRow)
+{
+    Q_UNUSED(sourceParent)
+    Q_UNUSED(destinationParent)
+
+    m_movedFirst = proxyRow(sourceStart);
+    m_movedLast = proxyRow(sourceEnd + 1) - 1;
+    m_movedDestination = proxyRow(destinationRow);
+
+    // a move that leaves the proxy rows in the same order isn't reported
+    m_isMoveReported = m_movedFirst <= m_movedLast
+            && beginMoveRows(QModelIndex(), m_movedFirst, m_movedLast, QModelIndex(), m_movedDestination);
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceRowsMoved
+ * \param sourceParent
+ * \param sourceStart
+ * \param sourceEnd
+ * \param destinationParent
+ * \param destinationRow
+ */
+void NoteFilterProxyModel::onSourceRowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                             const QModelIndex &destinationParent, int destinationRow)
+{
+    Q_UNUSED(sourceParent)
+    Q_UNUSED(destinationParent)
+
+    if(m_isMoveReported){
+        auto begin = m_sourceRows.begin();
+        if(m_movedDestination > m_movedLast)
+            std::rotate(begin + m_movedFirst, begin + m_movedLast + 1, begin + m_movedDestination);
+        else
+            std::rotate(begin + m_movedDestination, begin + m_movedFirst, begin + m_movedLast + 1);
+    }
+
+    // the source rows as they are after the move
+    int count = sourceEnd - sourceStart + 1;
+    for(int& sourceRow : m_sourceRows){
+        if(sourceRow >= sourceStart && sourceRow <= sourceEnd){
+            sourceRow += (destinationRow > sourceEnd) ? destinationRow - sourceEnd - 1 : destinationRow - sourceStart;
+        }else if(destinationRow > sourceEnd && sourceRow > sourceEnd && sourceRow < destinationRow){
+            sourceRow -= count;
+        }else if(destinationRow < sourceStart && sourceRow >= destinationRow && sourceRow < sourceStart){
+            sourceRow += count;
+        }
+    }
+
+    if(m_isMoveReported)
+        endMoveRows();
+    m_isMoveReported = false;
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceDataChanged
+ * A note whose id changed can enter or leave the search results,
+ * and is the only change that needs the notes to be filtered again
+ * \param topLeft
+ * \param bottomRight
+ * \param roles
+ */
+void NoteFilterProxyModel::onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight,
+                                               const QVector<int> &roles)
+{
+    if(m_isFiltering && (roles.isEmpty() || roles.contains(NoteModel::NoteID)))
+        setSourceRows(acceptedRows());
+
+    int firstRow = proxyRow(topLeft.row());
+    int lastRow = proxyRow(bottomRight.row() + 1) - 1;
+    if(firstRow <= lastRow)
+        emit dataChanged(index(firstRow, topLeft.column()), index(lastRow, bottomRight.column()), roles);
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceLayoutAboutToBeChanged
+ * Keep the source index of each persistent index, to find them back once the rows are sorted
+ */
+void NoteFilterProxyModel::onSourceLayoutAboutToBeChanged()
+{
+    emit layoutAboutToBeChanged();
+
+    m_layoutChangeIndexes = persistentIndexList();
+    m_layoutChangeSourceIndexes.clear();
+    m_layoutChangeSourceIndexes.reserve(m_layoutChangeIndexes.size());
+    for(const QModelIndex& index : m_layoutChangeIndexes)
+        m_layoutChangeSourceIndexes.append(QPersistentModelIndex(mapToSource(index)));
+}
+
+/*!
+ * \brief NoteFilterProxyModel::onSourceLayoutChanged
+ */
+void NoteFilterProxyModel::onSourceLayoutChanged()
+{
+    m_sourceRows = acceptedRows();
+
+    QModelIndexList newIndexes;
+    newIndexes.reserve(m_layoutChangeSourceIndexes.size());
+    for(const QPersistentModelIndex& sourceIndex : m_layoutChangeSourceIndexes)
+        newIndexes.append(mapFromSource(sourceIndex));
+    changePersistentIndexList(m_layoutChangeIndexes, newIndexes);
+
+    m_layoutChangeIndexes.clear();
+    m_layoutChangeSourceIndexes.clear();
+
+    emit layoutChanged();
+}
+
+void NoteFilterProxyModel::onSourceModelAboutToBeReset()
+{
+    beginResetModel();
+}
+
+void NoteFilterProxyModel::onSourceModelReset()
+{
+    m_sourceRows = acceptedRows();
+    endResetModel();
+}
@@ -0,0 +1,70 @@
+#ifndef NOTEFILTERPROXYMODEL_H
+#define NOTEFILTERPROXYMODEL_H
+
+#include <QAbstractProxyModel>
+#include <QPersistentModelIndex>
+#include <QSet>
+#include <QVector>
+
+/*!
+ * \brief The NoteFilterProxyModel class
+ * Shows the notes of the source model whose id is in the search results, in the source order.
+ * The proxy keeps the source row of each of its rows, so a search narrowing the previous one
+ * only re-tests the notes still shown, and the changes of the source model are applied
+ * to the rows they touch instead of filtering every note again
+ */
+class NoteFilterProxyModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+
+    friend class tst_NoteFilterProxyModel;
+
+public:
+    explicit NoteFilterProxyModel(QObject *parent = Q_NULLPTR);
+
+    void setSourceModel(QAbstractItemModel *sourceModel) Q_DECL_OVERRIDE;
+
+    void setNoteIdFilter(const QList<int>& noteIdList);
+    void clearNoteIdFilter();
+    bool isFiltering() const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QModelIndex parent(const QModelIndex &child) const Q_DECL_OVERRIDE;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const Q_DECL_OVERRIDE;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const Q_DECL_OVERRIDE;
+
+private:
+    QVector<int> m_sourceRows;
+    QSet<int> m_acceptedNoteIds;
+    bool m_isFiltering;
+    int m_movedFirst;
+    int m_movedLast;
+    int m_movedDestination;
+    bool m_isMoveReported;
+    QModelIndexList m_layoutChangeIndexes;
+    QList<QPersistentModelIndex> m_layoutChangeSourceIndexes;
+
+    bool acceptsRow(int sourceRow) const;
+    QVector<int> acceptedRows() const;
+    int proxyRow(int sourceRow) const;
+    void setSourceRows(const QVector<int>& sourceRows);
+
+private slots:
+    void onSourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceRowsAboutToBeMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                                    const QModelIndex &destinationParent, int destinationRow);
+    void onSourceRowsMoved(const QModelIndex &sourceParent, int sourceStart, int sourceEnd,
+                           const QModelIndex &destinationParent, int destinationRow);
+    void onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void onSourceLayoutAboutToBeChanged();
+    void onSourceLayoutChanged();
+    void onSourceModelAboutToBeReset();
+    void onSourceModelReset();
+};
+
+#endif // NOTEFILTERPROXYMODEL_H
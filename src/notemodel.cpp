@@ -1,8 +1,49 @@
 #include "notemodel.h"
 #include <QDebug>
+#include <algorithm>
+#include <numeric>
+
+#define CONTENT_CACHE_CAPACITY (8 * 1024 * 1024)
+#define TITLE_POOL_MIN_UNUSED 4096
+#define REORDER_MOVES_MAX 64
+
+/*!
+ * \brief moveElement
+ * Same as QList::move, the element at 'from' ends up at 'to'
+ * \param vector
+ * \param from
+ * \param to
+ */
+template <typename T>
+static void moveElement(QVector<T>& vector, int from, int to)
+{
+    if(from < to)
+        std::rotate(vector.begin() + from, vector.begin() + from + 1, vector.begin() + to + 1);
+    else
+        std::rotate(vector.begin() + to, vector.begin() + from, vector.begin() + from + 1);
+}
+
+/*!
+ * \brief permute
+ * \param vector
+ * \param order the row each element is taken from
+ */
+template <typename T>
+static void permute(QVector<T>& vector, const QVector<int>& order)
+{
+    QVector<T> permuted;
+    permuted.reserve(order.size());
+    for(int row : order)
+        permuted.append(vector.at(row));
+    vector.swap(permuted);
+}
 
 NoteModel::NoteModel(QObject *parent)
-    : QAbstractListModel(parent)
+    : QAbstractListModel(parent),
+      m_titlePoolUnused(0),
+      m_isRowIndexStale(false),
+      m_contentCacheCapacity(CONTENT_CACHE_CAPACITY),
+      m_contentCacheSize(0)
 {
 
 }
@@ -12,52 +53,444 @@ NoteModel::~NoteModel()
 
 }
 
+void NoteModel::setContentLoader(const ContentLoader& contentLoader)
+{
+    m_contentLoader = contentLoader;
+}
+
+void NoteModel::setContentCacheCapacity(qint64 capacity)
+{
+    m_contentCacheCapacity = capacity;
+}
+
+/*!
+ * \brief NoteModel::storeNote
+ * Copy the note into the arrays at 'row'. The model owns the note from now on
+ * and deletes it
+ * \param row
+ * \param note
+ */
+void NoteModel::storeNote(int row, NoteData* note)
+{
+    QString fullTitle = note->fullTitle();
+
+    // appending keeps the other rows, inserting before them shifts them all
+    if(row == m_ids.size() && !m_isRowIndexStale)
+        m_rowsById.insert(note->id(), row);
+    else
+        m_isRowIndexStale = true;
+
+    m_ids.insert(row, note->id());
+    m_creationDates.insert(row, note->creationDate());
+    m_modificationDates.insert(row, note->lastModificationDate());
+    m_deletionDates.insert(row, note->deletionDate());
+    m_titleOffsets.insert(row, m_titlePool.size());
+    m_titleSizes.insert(row, fullTitle.size());
+    m_scrollBarPositions.insert(row, note->scrollBarPosition());
+    m_titlePool.append(fullTitle);
+
+    if(note->isContentLoaded())
+        setContent(note->id(), note->content());
+
+    delete note;
+}
+
+/*!
+ * \brief NoteModel::eraseNote
+ * \param row
+ */
+void NoteModel::eraseNote(int row)
+{
+    m_titlePoolUnused += m_titleSizes.at(row);
+    forgetContent(m_ids.at(row));
+
+    if(row == m_ids.size() - 1 && !m_isRowIndexStale)
+        m_rowsById.remove(m_ids.at(row));
+    else
+        m_isRowIndexStale = true;
+
+    m_ids.remove(row);
+    m_creationDates.remove(row);
+    m_modificationDates.remove(row);
+    m_deletionDates.remove(row);
+    m_titleOffsets.remove(row);
+    m_titleSizes.remove(row);
+    m_scrollBarPositions.remove(row);
+
+    compactTitlePool();
+}
+
+QString NoteModel::title(int row) const
+{
+    return m_titlePool.mid(m_titleOffsets.at(row), m_titleSizes.at(row));
+}
+
+/*!
+ * \brief NoteModel::setTitle
+ * A title that fits where the old one was is written in place,
+ * otherwise it is appended to the pool
+ * \param row
+ * \param title
+ */
+void NoteModel::setTitle(int row, const QString& title)
+{
+    int oldSize = m_titleSizes.at(row);
+    if(title.size() <= oldSize){
+        m_titlePool.replace(m_titleOffsets.at(row), title.size(), title);
+    }else{
+        m_titleOffsets[row] = m_titlePool.size();
+        m_titlePool.append(title);
+    }
+
+    m_titlePoolUnused += oldSize - (title.size() <= oldSize ? title.size() : 0);
+    m_titleSizes[row] = title.size();
+
+    compactTitlePool();
+}
+
+/*!
+ * \brief NoteModel::compactTitlePool
+ * Rewrite the pool without the space left by edited and removed titles,
+ * once it is more than half of the pool
+ */
+void NoteModel::compactTitlePool()
+{
+    if(m_titlePoolUnused < TITLE_POOL_MIN_UNUSED || m_titlePoolUnused * 2 < m_titlePool.size())
+        return;
+
+    QString pool;
+    pool.reserve(m_titlePool.size() - m_titlePoolUnused);
+    for(int row = 0; row < m_ids.size(); ++row){
+        int offset = pool.size();
+        pool.append(m_titlePool.constData() + m_titleOffsets.at(row), m_titleSizes.at(row));
+        m_titleOffsets[row] = offset;
+    }
+
+    m_titlePool = pool;
+    m_titlePoolUnused = 0;
+}
+
+/*!
+ * \brief NoteModel::content
+ * The content of the note at 'row', loaded if it isn't in the cache
+ * \param row
+ * \return
+ */
+QString NoteModel::content(int row) const
+{
+    int id = m_ids.at(row);
+    auto it = m_contentCache.find(id);
+    if(it != m_contentCache.end()){
+        m_contentLru.splice(m_contentLru.begin(), m_contentLru, it->lruPosition);
+        return it->content;
+    }
+
+    if(!m_contentLoader)
+        return QString();
+
+    QString loaded = m_contentLoader(id);
+    setContent(id, loaded);
+    return loaded;
+}
+
+/*!
+ * \brief NoteModel::setContent
+ * Cache the content of the note as the most recently used one
+ * and release the least recently used contents if the cache is full.
+ * A dirty content is an edit the database doesn't have yet, it stays
+ * in the cache until markContentSaved is called for it
+ * \param id
+ * \param content
+ * \param isDirty
+ */
+void NoteModel::setContent(int id, const QString& content, bool isDirty) const
+{
+    auto it = m_contentCache.find(id);
+    if(it != m_contentCache.end()){
+        m_contentLru.splice(m_contentLru.begin(), m_contentLru, it->lruPosition);
+        m_contentCacheSize += content.size() - it->content.size();
+        it->content = content;
+        it->isDirty = it->isDirty || isDirty;
+    }else{
+        m_contentLru.push_front(id);
+        ContentCacheEntry entry = {m_contentLru.begin(), content, isDirty};
+        m_contentCache.insert(id, entry);
+        m_contentCacheSize += content.size();
+    }
+
+    trimContentCache();
+}
+
+/*!
+ * \brief NoteModel::trimContentCache
+ * Release the least recently used contents until the cache fits its capacity.
+ * The most recently used content and the dirty ones are never released
+ */
+void NoteModel::trimContentCache() const
+{
+    // a note without a loader can't get its content back
+    if(!m_contentLoader || m_contentLru.empty())
+        return;
+
+    auto it = m_contentLru.end();
+    while(m_contentCacheSize > m_contentCacheCapacity && --it != m_contentLru.begin()){
+        auto entry = m_contentCache.find(*it);
+        if(entry->isDirty)
+            continue;
+
+        m_contentCacheSize -= entry->content.size();
+        m_contentCache.erase(entry);
+        it = m_contentLru.erase(it);
+    }
+}
+
+/*!
+ * \brief NoteModel::markContentSaved
+ * The database has the notes of 'noteIdList' as they were at 'modificationDateList',
+ * their contents can be released unless they were edited again since
+ * \param noteIdList
+ * \param modificationDateList
+ */
+void NoteModel::markContentSaved(const QList<int>& noteIdList, const QList<qint64>& modificationDateList)
+{
+    for(int i = 0; i < noteIdList.size(); ++i){
+        auto it = m_contentCache.find(noteIdList.at(i));
+        if(it == m_contentCache.end() || !it->isDirty)
+            continue;
+
+        int row = noteRow(noteIdList.at(i));
+        if(row != -1 && m_modificationDates.at(row) > modificationDateList.at(i))
+            continue;
+
+        it->isDirty = false;
+    }
+
+    trimContentCache();
+}
+
+void NoteModel::forgetContent(int id)
+{
+    auto it = m_contentCache.find(id);
+    if(it != m_contentCache.end()){
+        m_contentLru.erase(it->lruPosition);
+        m_contentCacheSize -= it->content.size();
+        m_contentCache.erase(it);
+    }
+}
+
+/*!
+ * \brief NoteModel::sortedRow
+ * Binary search the rows from 'first' for where a note modified at 'modificationDate' belongs.
+ * The rows are kept most recently modified first, a note goes after the ones with the same date
+ * \param modificationDate
+ * \param first
+ * \return
+ */
+int NoteModel::sortedRow(qint64 modificationDate, int first) const
+{
+    auto position = std::upper_bound(m_modificationDates.constBegin() + first, m_modificationDates.constEnd(),
+                                     modificationDate, std::greater<qint64>());
+    return int(position - m_modificationDates.constBegin());
+}
+
+/*!
+ * \brief NoteModel::moveNote
+ * Move the note at 'from' so it ends up at 'to' with a single rowsMoved
+ * \param from
+ * \param to
+ */
+void NoteModel::moveNote(int from, int to)
+{
+    if(from == to)
+        return;
+
+    // the destination of beginMoveRows is counted before the row is taken out
+    beginMoveRows(QModelIndex(), from, from, QModelIndex(), to > from ? to + 1 : to);
+    moveElement(m_ids, from, to);
+    moveElement(m_creationDates, from, to);
+    moveElement(m_modificationDates, from, to);
+    moveElement(m_deletionDates, from, to);
+    moveElement(m_titleOffsets, from, to);
+    moveElement(m_titleSizes, from, to);
+    moveElement(m_scrollBarPositions, from, to);
+
+    // only the rows between 'from' and 'to' changed
+    if(!m_isRowIndexStale){
+        for(int row = qMin(from, to); row <= qMax(from, to); ++row)
+            m_rowsById[m_ids.at(row)] = row;
+    }
+
+    endMoveRows();
+}
+
+/*!
+ * \brief NoteModel::noteRow
+ * The rows are looked up in a hash of the ids, rebuilt on the first lookup
+ * after the rows were shifted or reordered
+ * \param id
+ * \return the row of the note with this id, -1 if there is none
+ */
+int NoteModel::noteRow(int id) const
+{
+    if(m_isRowIndexStale){
+        m_rowsById.clear();
+        m_rowsById.reserve(m_ids.size());
+        for(int row = 0; row < m_ids.size(); ++row)
+            m_rowsById.insert(m_ids.at(row), row);
+        m_isRowIndexStale = false;
+    }
+
+    return m_rowsById.value(id, -1);
+}
+
+/*!
+ * \brief NoteModel::restoreOrder
+ * Move the note at 'row', whose modification date changed, back where it belongs
+ * \param row
+ * \return the row of the note
+ */
+int NoteModel::restoreOrder(int row)
+{
+    qint64 modificationDate = m_modificationDates.at(row);
+    int to = row;
+    if(row > 0 && m_modificationDates.at(row - 1) < modificationDate){
+        auto position = std::upper_bound(m_modificationDates.constBegin(), m_modificationDates.constBegin() + row,
+                                         modificationDate, std::greater<qint64>());
+        to = int(position - m_modificationDates.constBegin());
+    }else if(row < rowCount() - 1 && m_modificationDates.at(row + 1) > modificationDate){
+        // counted without the note itself
+        to = sortedRow(modificationDate, row + 1) - 1;
+    }
+
+    moveNote(row, to);
+    return to;
+}
+
+/*!
+ * \brief NoteModel::addNote
+ * Insert the note where its modification date puts it
+ * \param note
+ * \return
+ */
 QModelIndex NoteModel::addNote(NoteData* note)
 {
-    const int rowCnt = rowCount();
-    beginInsertRows(QModelIndex(), rowCnt, rowCnt);
-    m_noteList << note;
+    const int row = sortedRow(note->lastModificationDate());
+    beginInsertRows(QModelIndex(), row, row);
+    storeNote(row, note);
     endInsertRows();
 
-    return createIndex(rowCnt, 0);
+    return createIndex(row, 0);
 }
 
+/*!
+ * \brief NoteModel::insertNote
+ * Insert the note at 'row', which has to keep the rows in modification date order
+ * \param note
+ * \param row
+ * \return
+ */
 QModelIndex NoteModel::insertNote(NoteData *note, int row)
 {
-    if(row >= rowCount()){
-        return addNote(note);
-    }else{
-        beginInsertRows(QModelIndex(), row, row);
-        m_noteList.insert(row, note);
-        endInsertRows();
-    }
+    row = qMin(row, rowCount());
+    beginInsertRows(QModelIndex(), row, row);
+    storeNote(row, note);
+    endInsertRows();
 
     return createIndex(row,0);
 }
 
+/*!
+ * \brief NoteModel::noteIndex
+ * \param id
+ * \return the index of the note with this id, an invalid index if there is none
+ */
+QModelIndex NoteModel::noteIndex(int id) const
+{
+    int row = noteRow(id);
+    return row == -1 ? QModelIndex() : createIndex(row, 0);
+}
+
+/*!
+ * \brief NoteModel::getNote
+ * \param index
+ * \return a copy of the note with its content, owned by the caller
+ */
 NoteData* NoteModel::getNote(const QModelIndex& index)
 {
-    if(index.isValid()){
-        return m_noteList.at(index.row());
-    }else{
+    if(!index.isValid())
         return Q_NULLPTR;
-    }
+
+    int row = index.row();
+    NoteData* note = new NoteData();
+    note->setId(m_ids.at(row));
+    note->setFullTitle(title(row));
+    note->setCreationDate(m_creationDates.at(row));
+    note->setLastModificationDate(m_modificationDates.at(row));
+    note->setDeletionDate(m_deletionDates.at(row));
+    note->setScrollBarPosition(m_scrollBarPositions.at(row));
+    note->setContent(content(row));
+    return note;
 }
 
+/*!
+ * \brief NoteModel::addListNote
+ * Merge the notes into the rows. A page of the notes list, sorted and older than
+ * every row, is appended at once. Otherwise the notes are sorted, and each run of notes
+ * falling between the same two rows is found by a binary search and inserted at once
+ * \param noteList
+ */
 void NoteModel::addListNote(QList<NoteData *> noteList)
 {
-    int start = rowCount();
-    int end = start + noteList.count()-1;
-    beginInsertRows(QModelIndex(), start, end);
-    m_noteList << noteList;
-    endInsertRows();
+    if(noteList.isEmpty())
+        return;
+
+    auto isMoreRecent = [](NoteData* lhs, NoteData* rhs){
+        return lhs->lastModificationDate() > rhs->lastModificationDate();
+    };
+
+    int finalCount = rowCount() + noteList.count();
+    for(QVector<int>* vector : {&m_ids, &m_titleOffsets, &m_titleSizes, &m_scrollBarPositions})
+        vector->reserve(finalCount);
+    for(QVector<qint64>* vector : {&m_creationDates, &m_modificationDates, &m_deletionDates})
+        vector->reserve(finalCount);
+
+    if(!std::is_sorted(noteList.begin(), noteList.end(), isMoreRecent))
+        std::stable_sort(noteList.begin(), noteList.end(), isMoreRecent);
+
+    int first = 0;
+    int searchFrom = 0;
+    while(first < noteList.count()){
+        int row = sortedRow(noteList.at(first)->lastModificationDate(), searchFrom);
+
+        // the next notes go right after this one until a row is older than them
+        int last = first + 1;
+        while(last < noteList.count()
+              && (row == rowCount() || m_modificationDates.at(row) < noteList.at(last)->lastModificationDate()))
+            ++last;
+
+        beginInsertRows(QModelIndex(), row, row + last - first - 1);
+        for(int i = first; i < last; ++i)
+            storeNote(row + i - first, noteList.at(i));
+        endInsertRows();
+
+        searchFrom = row + last - first;
+        first = last;
+    }
 }
 
+/*!
+ * \brief NoteModel::removeNote
+ * \param noteIndex
+ * \return the removed note with its content, owned by the caller
+ */
 NoteData* NoteModel::removeNote(const QModelIndex &noteIndex)
 {
+    // the caller gets the note with its content
+    NoteData* note = getNote(noteIndex);
+
     int row = noteIndex.row();
     beginRemoveRows(QModelIndex(), row, row);
-    NoteData* note = m_noteList.takeAt(row);
+    eraseNote(row);
     endRemoveRows();
 
     return note;
@@ -66,16 +499,17 @@ NoteData* NoteModel::removeNote(const QModelIndex &noteIndex)
 bool NoteModel::moveRow(const QModelIndex &sourceParent, int sourceRow, const QModelIndex &destinationParent, int destinationChild)
 {
     if(sourceRow<0
-            || sourceRow >= m_noteList.count()
+            || sourceRow >= m_ids.count()
             || destinationChild <0
-            || destinationChild >= m_noteList.count()){
+            || destinationChild >= m_ids.count()){
 
         return false;
     }
 
-    beginMoveRows(sourceParent,sourceRow,sourceRow,destinationParent,destinationChild);
-    m_noteList.move(sourceRow,destinationChild);
-    endMoveRows();
+    Q_UNUSED(sourceParent)
+    Q_UNUSED(destinationParent)
+
+    moveNote(sourceRow, destinationChild);
 
     return true;
 }
@@ -83,68 +517,212 @@ bool NoteModel::moveRow(const QModelIndex &sourceParent, int sourceRow, const QM
 void NoteModel::clearNotes()
 {
     beginResetModel();
-    m_noteList.clear();
+    m_ids.clear();
+    m_creationDates.clear();
+    m_modificationDates.clear();
+    m_deletionDates.clear();
+    m_titleOffsets.clear();
+    m_titleSizes.clear();
+    m_scrollBarPositions.clear();
+    m_titlePool.clear();
+    m_titlePoolUnused = 0;
+    m_rowsById.clear();
+    m_isRowIndexStale = false;
+    m_contentLru.clear();
+    m_contentCache.clear();
+    m_contentCacheSize = 0;
     endResetModel();
 }
 
 QVariant NoteModel::data(const QModelIndex &index, int role) const
 {
-    if (index.row() < 0 || index.row() >= m_noteList.count())
+    int row = index.row();
+    if (row < 0 || row >= m_ids.count())
         return QVariant();
 
-    NoteData* note = m_noteList[index.row()];
     if(role == NoteID){
-        return note->id();
+        return m_ids.at(row);
     }else if(role == NoteFullTitle){
-        return note->fullTitle();
+        return title(row);
     }else if(role == NoteCreationDateTime){
-        return note->creationDateTime();
+        return m_creationDates.at(row);
     }else if(role == NoteLastModificationDateTime){
-        return note->lastModificationdateTime();
+        return m_modificationDates.at(row);
     }else if(role == NoteDeletionDateTime){
-        return note->deletionDateTime();
+        return m_deletionDates.at(row);
     }else if(role == NoteContent){
-        return note->content();
+        return content(row);
     }else if(role == NoteScrollbarPos){
-        return note->scrollBarPosition();
+        return m_scrollBarPositions.at(row);
     }
 
     return QVariant();
 }
 
-bool NoteModel::setData(const QModelIndex &index, const QVariant &value, int role)
+/*!
+ * \brief NoteModel::storeField
+ * Store one role of the note at 'row', without moving it or notifying the views
+ * \param row
+ * \param role
+ * \param value
+ * \return false if the role can't be set
+ */
+bool NoteModel::storeField(int row, int role, const QVariant& value)
 {
-    if (!index.isValid())
-        return false;
-
-    NoteData* note = m_noteList[index.row()];
-
-
     if(role == NoteID){
-        note->setId(value.toInt());
+        int id = value.toInt();
+        auto it = m_contentCache.find(m_ids.at(row));
+        if(it != m_contentCache.end()){
+            QString cachedContent = it->content;
+            bool isDirty = it->isDirty;
+            forgetContent(m_ids.at(row));
+            setContent(id, cachedContent, isDirty);
+        }
+        if(!m_isRowIndexStale){
+            m_rowsById.remove(m_ids.at(row));
+            m_rowsById.insert(id, row);
+        }
+        m_ids[row] = id;
     }else if(role == NoteFullTitle){
-        note->setFullTitle(value.toString());
+        setTitle(row, value.toString());
     }else if(role == NoteCreationDateTime){
-        note->setCreationDateTime(value.toDateTime());
+        m_creationDates[row] = value.toLongLong();
     }else if(role == NoteLastModificationDateTime){
-        note->setLastModificationDateTime(value.toDateTime());
+        m_modificationDates[row] = value.toLongLong();
     }else if(role == NoteDeletionDateTime){
-        note->setDeletionDateTime(value.toDateTime());
+        m_deletionDates[row] = value.toLongLong();
     }else if(role == NoteContent){
-        note->setContent(value.toString());
+        setContent(m_ids.at(row), value.toString(), true);
     }else if(role == NoteScrollbarPos){
-        note->setScrollBarPosition(value.toInt());
+        m_scrollBarPositions[row] = value.toInt();
     }else{
         return false;
     }
 
-    emit dataChanged(this->index(index.row()),
-                     this->index(index.row()),
+    return true;
+}
+
+bool NoteModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || !storeField(index.row(), role, value))
+        return false;
+
+    int row = (role == NoteLastModificationDateTime) ? restoreOrder(index.row()) : index.row();
+
+    emit dataChanged(this->index(row),
+                     this->index(row),
                      QVector<int>(1,role));
 
     return true;
 }
 
+/*!
+ * \brief NoteModel::setItemData
+ * Set every role of the note at once, the note is moved at most once
+ * and a single dataChanged carries all the roles
+ * \param index
+ * \param roles
+ * \return false if one of the roles can't be set, the others are still set
+ */
+bool NoteModel::setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles)
+{
+    if (!index.isValid())
+        return false;
+
+    int row = index.row();
+    bool isStored = true;
+    QVector<int> changedRoles;
+    changedRoles.reserve(roles.size());
+    for(auto it = roles.constBegin(); it != roles.constEnd(); ++it){
+        if(storeField(row, it.key(), it.value()))
+            changedRoles.append(it.key());
+        else
+            isStored = false;
+    }
+
+    if(changedRoles.isEmpty())
+        return false;
+
+    if(changedRoles.contains(NoteLastModificationDateTime))
+        row = restoreOrder(row);
+
+    emit dataChanged(this->index(row), this->index(row), changedRoles);
+
+    return isStored;
+}
+
+/*!
+ * \brief NoteModel::setNotesData
+ * Set the roles of several notes, found by their id, at once.
+ * Each note whose modification date changed is moved back in order right away,
+ * unless more than REORDER_MOVES_MAX of them did, then the rows are sorted once
+ * with a single layout change. Each run of adjacent updated rows gets one dataChanged
+ * with every role set
+ * \param notesData the roles to set, by note id
+ * \return false if one of the notes isn't in the model or one of the roles can't be set
+ */
+bool NoteModel::setNotesData(const QHash<int, QMap<int, QVariant>>& notesData)
+{
+    int reorderedCount = 0;
+    for(const QMap<int, QVariant>& roles : notesData){
+        if(roles.contains(NoteLastModificationDateTime))
+            ++reorderedCount;
+    }
+    bool isSorted = reorderedCount > REORDER_MOVES_MAX;
+
+    bool isStored = true;
+    QVector<int> changedRoles;
+    QVector<int> updatedIds;
+    updatedIds.reserve(notesData.size());
+
+    for(auto note = notesData.constBegin(); note != notesData.constEnd(); ++note){
+        int row = noteRow(note.key());
+        if(row == -1){
+            isStored = false;
+            continue;
+        }
+
+        for(auto it = note->constBegin(); it != note->constEnd(); ++it){
+            if(!storeField(row, it.key(), it.value())){
+                isStored = false;
+                continue;
+            }
+            if(!changedRoles.contains(it.key()))
+                changedRoles.append(it.key());
+        }
+
+        // the other rows are still in order, a binary search finds where this one goes
+        if(!isSorted && note->contains(NoteLastModificationDateTime))
+            row = restoreOrder(row);
+
+        // the id as set by this update
+        updatedIds.append(m_ids.at(row));
+    }
+
+    if(updatedIds.isEmpty())
+        return isStored;
+
+    if(isSorted)
+        sort(0, Qt::DescendingOrder);
+
+    QVector<int> updatedRows;
+    updatedRows.reserve(updatedIds.size());
+    for(int id : updatedIds)
+        updatedRows.append(noteRow(id));
+    std::sort(updatedRows.begin(), updatedRows.end());
+
+    int first = 0;
+    while(first < updatedRows.size()){
+        int last = first;
+        while(last + 1 < updatedRows.size() && updatedRows.at(last + 1) == updatedRows.at(last) + 1)
+            ++last;
+        emit dataChanged(index(updatedRows.at(first)), index(updatedRows.at(last)), changedRoles);
+        first = last + 1;
+    }
+
+    return isStored;
+}
+
 Qt::ItemFlags NoteModel::flags(const QModelIndex &index) const
 {
     if (!index.isValid())
@@ -157,17 +735,53 @@ int NoteModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
 
-    return m_noteList.count();
+    return m_ids.count();
 }
 
+/*!
+ * \brief NoteModel::sort
+ * Sort the rows by modification date, most recent first, for rows put out of order
+ * with insertNote or moveRow. The order is computed on the dates alone, applied to
+ * every array and reported as a single layout change
+ * \param column
+ * \param order
+ */
 void NoteModel::sort(int column, Qt::SortOrder order)
 {
     Q_UNUSED(column)
     Q_UNUSED(order)
 
-    std::stable_sort(m_noteList.begin(), m_noteList.end(), [](NoteData* lhs, NoteData* rhs){
-        return lhs->lastModificationdateTime() > rhs->lastModificationdateTime();
+    // the rows are kept sorted, see addListNote and restoreOrder
+    if(std::is_sorted(m_modificationDates.constBegin(), m_modificationDates.constEnd(), std::greater<qint64>()))
+        return;
+
+    emit layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+    QVector<int> rowOrder(m_ids.size());
+    std::iota(rowOrder.begin(), rowOrder.end(), 0);
+    std::stable_sort(rowOrder.begin(), rowOrder.end(), [this](int lhs, int rhs){
+        return m_modificationDates.at(lhs) > m_modificationDates.at(rhs);
     });
 
-    emit dataChanged(index(0), index(rowCount()-1));
+    permute(m_ids, rowOrder);
+    permute(m_creationDates, rowOrder);
+    permute(m_modificationDates, rowOrder);
+    permute(m_deletionDates, rowOrder);
+    permute(m_titleOffsets, rowOrder);
+    permute(m_titleSizes, rowOrder);
+    permute(m_scrollBarPositions, rowOrder);
+    m_isRowIndexStale = true;
+
+    QVector<int> newRows(rowOrder.size());
+    for(int row = 0; row < rowOrder.size(); ++row)
+        newRows[rowOrder.at(row)] = row;
+
+    QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList newIndexes;
+    newIndexes.reserve(oldIndexes.size());
+    for(const QModelIndex& oldIndex : oldIndexes)
+        newIndexes.append(index(newRows.at(oldIndex.row())));
+    changePersistentIndexList(oldIndexes, newIndexes);
+
+    emit layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
 }
@@ -2,8 +2,22 @@
 #define NOTEMODEL_H
 
 #include <QAbstractListModel>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <functional>
+#include <list>
 #include "notedata.h"
 
+/*!
+ * \brief The NoteModel class
+ * The notes are kept as a struct of arrays, one contiguous vector per field and
+ * one entry per row. The titles are stored back to back in a single pool
+ * and the contents in a cache bounded by setContentCacheCapacity, which keeps
+ * the edits until markContentSaved says the database has them.
+ * The rows stay in modification date order, most recent first, as notes are added and edited.
+ * NoteData is only used to hand notes in and out of the model
+ */
 class NoteModel : public QAbstractListModel
 {
 
@@ -11,6 +25,7 @@ class NoteModel : public QAbstractListModel
 
 public:
 
+    // the dates are milliseconds since epoch, -1 when not set
     enum NoteRoles{
         NoteID = Qt::UserRole + 1,
         NoteFullTitle,
@@ -21,12 +36,19 @@ public:
         NoteScrollbarPos
     };
 
+    typedef std::function<QString(int)> ContentLoader;
+
     explicit NoteModel(QObject *parent = Q_NULLPTR);
     ~NoteModel();
 
+    void setContentLoader(const ContentLoader& contentLoader);
+    void setContentCacheCapacity(qint64 capacity);
+    void markContentSaved(const QList<int>& noteIdList, const QList<qint64>& modificationDateList);
+
     QModelIndex addNote(NoteData* note);
     QModelIndex insertNote(NoteData* note, int row);
     NoteData* getNote(const QModelIndex& index);
+    QModelIndex noteIndex(int id) const;
     void addListNote(QList<NoteData*> noteList);
     NoteData* removeNote(const QModelIndex& noteIndex);
     bool moveRow(const QModelIndex& sourceParent,
@@ -37,12 +59,52 @@ public:
     void clearNotes();
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const Q_DECL_OVERRIDE;
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) Q_DECL_OVERRIDE;
+    bool setItemData(const QModelIndex &index, const QMap<int, QVariant> &roles) Q_DECL_OVERRIDE;
+    bool setNotesData(const QHash<int, QMap<int, QVariant>>& notesData);
     Qt::ItemFlags flags(const QModelIndex &index) const Q_DECL_OVERRIDE;
     int rowCount(const QModelIndex &parent = QModelIndex()) const Q_DECL_OVERRIDE;
     void sort(int column, Qt::SortOrder order) Q_DECL_OVERRIDE;
 
 private:
-    QList<NoteData *> m_noteList;
+    struct ContentCacheEntry{
+        std::list<int>::iterator lruPosition;
+        QString content;
+        bool isDirty;
+    };
+
+    QVector<int> m_ids;
+    QVector<qint64> m_creationDates;
+    QVector<qint64> m_modificationDates;
+    QVector<qint64> m_deletionDates;
+    QVector<int> m_titleOffsets;
+    QVector<int> m_titleSizes;
+    QVector<int> m_scrollBarPositions;
+    QString m_titlePool;
+    int m_titlePoolUnused;
+    mutable QHash<int, int> m_rowsById;
+    mutable bool m_isRowIndexStale;
+
+    ContentLoader m_contentLoader;
+    qint64 m_contentCacheCapacity;
+    mutable qint64 m_contentCacheSize;
+    mutable std::list<int> m_contentLru;
+    mutable QHash<int, ContentCacheEntry> m_contentCache;
+
+    int sortedRow(qint64 modificationDate, int first = 0) const;
+    int noteRow(int id) const;
+    void moveNote(int from, int to);
+    int restoreOrder(int row);
+    void storeNote(int row, NoteData* note);
+    bool storeField(int row, int role, const QVariant& value);
+    void eraseNote(int row);
+    QString title(int row) const;
+    void setTitle(int row, const QString& title);
+    void compactTitlePool();
+
+    QString content(int row) const;
+    void setContent(int id, const QString& content, bool isDirty = false) const;
+    void trimContentCache() const;
+    void forgetContent(int id);
 
 signals:
     void noteRemoved();
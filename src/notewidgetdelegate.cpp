@@ -31,7 +31,12 @@ NoteWidgetDelegate::NoteWidgetDelegate(QObject *parent)
       m_maxFrame(200),
       m_rowRightOffset(0),
       m_state(Normal),
-      m_isActive(false)
+      m_isActive(false),
+      m_dateLocale(QStringLiteral("en_US")),
+      m_tomorrowStart(0),
+      m_todayStart(0),
+      m_yesterdayStart(0),
+      m_lastWeekStart(0)
 {
     m_timeLine = new QTimeLine(300, this);
     m_timeLine->setFrameRange(0,m_maxFrame);
@@ -171,7 +176,7 @@ void NoteWidgetDelegate::paintLabels(QPainter* painter, const QStyleOptionViewIt
     QFontMetrics fmTitle(titleFont);
     QRect fmRectTitle = fmTitle.boundingRect(title);
 
-    QString date = parseDateTime(index.data(NoteModel::NoteLastModificationDateTime).toDateTime());
+    QString date = parseDateTime(index.data(NoteModel::NoteLastModificationDateTime).toLongLong());
     QFontMetrics fmDate(m_dateFont);
     QRect fmRectDate = fmDate.boundingRect(title);
 
@@ -248,22 +253,49 @@ void NoteWidgetDelegate::paintSeparator(QPainter*painter, const QStyleOptionView
                       QPoint(posX2, posY));
 }
 
-QString NoteWidgetDelegate::parseDateTime(const QDateTime &dateTime) const
+/*!
+ * \brief NoteWidgetDelegate::updateDayBoundaries
+ * Compute the starts of the days the labels depend on,
+ * once a day instead of for every painted row
+ */
+void NoteWidgetDelegate::updateDayBoundaries() const
 {
-    QLocale usLocale(QLocale("en_US"));
-
-    auto currDateTime = QDateTime::currentDateTime();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if(now >= m_todayStart && now < m_tomorrowStart)
+        return;
+
+    QDate today = QDate::currentDate();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    m_tomorrowStart = today.addDays(1).startOfDay().toMSecsSinceEpoch();
+    m_todayStart = today.startOfDay().toMSecsSinceEpoch();
+    m_yesterdayStart = today.addDays(-1).startOfDay().toMSecsSinceEpoch();
+    m_lastWeekStart = today.addDays(-7).startOfDay().toMSecsSinceEpoch();
+#else
+    m_tomorrowStart = QDateTime(today.addDays(1)).toMSecsSinceEpoch();
+    m_todayStart = QDateTime(today).toMSecsSinceEpoch();
+    m_yesterdayStart = QDateTime(today.addDays(-1)).toMSecsSinceEpoch();
+    m_lastWeekStart = QDateTime(today.addDays(-7)).toMSecsSinceEpoch();
+#endif
+}
 
-    if(dateTime.date() == currDateTime.date()){
-        return usLocale.toString(dateTime.time(),"h:mm A");
-    }else if(dateTime.daysTo(currDateTime) == 1){
-        return "Yesterday";
-    }else if(dateTime.daysTo(currDateTime) >= 2 &&
-             dateTime.daysTo(currDateTime) <= 7){
-        return usLocale.toString(dateTime.date(), "dddd");
+/*!
+ * \brief NoteWidgetDelegate::parseDateTime
+ * \param dateTime milliseconds since epoch
+ * \return the time for today, the day name for the last week, the date otherwise
+ */
+QString NoteWidgetDelegate::parseDateTime(qint64 dateTime) const
+{
+    updateDayBoundaries();
+
+    if(dateTime >= m_todayStart && dateTime < m_tomorrowStart){
+        return m_dateLocale.toString(QDateTime::fromMSecsSinceEpoch(dateTime).time(), QStringLiteral("h:mm A"));
+    }else if(dateTime >= m_yesterdayStart && dateTime < m_todayStart){
+        return QStringLiteral("Yesterday");
+    }else if(dateTime >= m_lastWeekStart && dateTime < m_yesterdayStart){
+        return m_dateLocale.toString(QDateTime::fromMSecsSinceEpoch(dateTime).date(), QStringLiteral("dddd"));
     }
 
-    return dateTime.date().toString("M/d/yy");
+    return QDateTime::fromMSecsSinceEpoch(dateTime).date().toString(QStringLiteral("M/d/yy"));
 }
 
 void NoteWidgetDelegate::setActive(bool isActive)
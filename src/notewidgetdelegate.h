@@ -3,6 +3,7 @@
 
 #include <QStyledItemDelegate>
 #include <QTimeLine>
+#include <QLocale>
 
 class NoteWidgetDelegate : public QStyledItemDelegate
 {
@@ -39,7 +40,8 @@ private:
     void paintBackground(QPainter* painter, const QStyleOptionViewItem &option, const QModelIndex &index)const;
     void paintLabels(QPainter* painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
     void paintSeparator(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
-    QString parseDateTime(const QDateTime& dateTime) const;
+    QString parseDateTime(qint64 dateTime) const;
+    void updateDayBoundaries() const;
 
     QFont m_titleFont;
     QFont m_titleSelectedFont;
@@ -57,6 +59,12 @@ private:
     int m_rowRightOffset;
     States m_state;
     bool m_isActive;
+    QLocale m_dateLocale;
+    // starts of days in milliseconds since epoch, see updateDayBoundaries
+    mutable qint64 m_tomorrowStart;
+    mutable qint64 m_todayStart;
+    mutable qint64 m_yesterdayStart;
+    mutable qint64 m_lastWeekStart;
 
     QTimeLine *m_timeLine;
     QModelIndex m_animatedIndex;
@@ -2,15 +2,21 @@
 #include <QTest>
 #include "tst_notedata.h"
 #include "tst_notemodel.h"
+#include "tst_notefilterproxymodel.h"
 #include "tst_noteview.h"
 #include "tst_mainwindow.h"
+#include "tst_dbmanager.h"
+#include "tst_editjournal.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
     QTest::qExec(new tst_NoteData, argc, argv);
     QTest::qExec(new tst_NoteModel, argc, argv);
+    QTest::qExec(new tst_NoteFilterProxyModel, argc, argv);
     QTest::qExec(new tst_NoteView, argc, argv);
     QTest::qExec(new tst_MainWindow, argc, argv);
+    QTest::qExec(new tst_DBManager, argc, argv);
+    QTest::qExec(new tst_EditJournal, argc, argv);
     return 0;
 }
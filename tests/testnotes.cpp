@@ -0,0 +1,33 @@
+#include "testnotes.h"
+
+/*!
+ * \brief generateNotes
+ * Notes as they come from the database, the most recently modified first,
+ * one second apart. Without a content size the notes are left without
+ * their content, as the notes list loads them
+ * \param count
+ * \param contentSize the length of the content after the title line
+ * \return
+ */
+QList<NoteData*> generateNotes(int count, int contentSize)
+{
+    QList<NoteData*> noteList;
+    noteList.reserve(count);
+
+    QDateTime dateTime = QDateTime::currentDateTime();
+    QString body = contentSize >= 0 ? QString(contentSize, QChar('x')) : QString();
+    for(int i = 0; i < count; ++i){
+        NoteData* note = new NoteData();
+        note->setId(i + 1);
+        note->setCreationDateTime(dateTime);
+        note->setLastModificationDateTime(dateTime.addSecs(-i));
+        note->setFullTitle(QStringLiteral("Note's title %1").arg(i));
+        if(contentSize >= 0)
+            note->setContent(QStringLiteral("Note's title %1\n").arg(i) + body);
+        else
+            note->setContentLoaded(false);
+        noteList.append(note);
+    }
+
+    return noteList;
+}
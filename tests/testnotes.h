@@ -0,0 +1,9 @@
+#ifndef TESTNOTES_H
+#define TESTNOTES_H
+
+#include <QList>
+#include "../src/notedata.h"
+
+QList<NoteData*> generateNotes(int count, int contentSize = -1);
+
+#endif // TESTNOTES_H
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += widgets testlib network
+QT       += widgets testlib network sql concurrent
 
 TARGET    = test
 CONFIG   += testcase
@@ -17,18 +17,47 @@ LIBS += -lX11
 }
 
 DEPENDPATH += ../src/OBJ
+INCLUDEPATH += ../src
+
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += NOTES_WITH_ZSTD
+}
 
 HEADERS += \
+    ../src/editjournal.h \
+    ../src/notebackup.h \
+    ../src/notedata.h \
+    ../src/notedelta.h \
+    ../src/notemodel.h \
+    ../src/notefilterproxymodel.h \
+    ../src/dbmanager.h \
+    testnotes.h \
+    tst_dbmanager.h \
+    tst_editjournal.h \
     tst_mainwindow.h \
     tst_notedata.h \
     tst_notemodel.h \
+    tst_notefilterproxymodel.h \
     tst_noteview.h
 
 SOURCES += \
+    ../src/editjournal.cpp \
+    ../src/notebackup.cpp \
+    ../src/notedata.cpp \
+    ../src/notedelta.cpp \
+    ../src/notemodel.cpp \
+    ../src/notefilterproxymodel.cpp \
+    ../src/dbmanager.cpp \
     main.cpp \
+    testnotes.cpp \
+    tst_dbmanager.cpp \
+    tst_editjournal.cpp \
     tst_notedata.cpp \
     tst_mainwindow.cpp \
     tst_notemodel.cpp \
+    tst_notefilterproxymodel.cpp \
     tst_noteview.cpp
 
 DEFINES += SRCDIR=\\\"$$PWD\\\"
@@ -0,0 +1,706 @@
+#include "tst_dbmanager.h"
+#include "../src/dbmanager.h"
+#include "../src/notebackup.h"
+#include "testnotes.h"
+#include <QSqlQuery>
+#include <QElapsedTimer>
+#include <algorithm>
+
+tst_DBManager::tst_DBManager()
+{
+
+}
+
+/*!
+ * \brief tst_DBManager::hasLargeBenchmarks
+ * The benchmarks only run rows small enough for every test run,
+ * unless NOTES_LARGE_BENCHMARKS is set in the environment
+ * \return
+ */
+bool tst_DBManager::hasLargeBenchmarks() const
+{
+    return qEnvironmentVariableIsSet("NOTES_LARGE_BENCHMARKS");
+}
+
+void tst_DBManager::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+}
+
+void tst_DBManager::cleanupTestCase()
+{
+
+}
+
+void tst_DBManager::benchmarkImport_data()
+{
+    QTest::addColumn<bool>("prepared");
+    QTest::addColumn<int>("noteCount");
+
+    QTest::newRow("adhoc SQL, 1k notes") << false << 1000;
+    QTest::newRow("prepared statements, 1k notes") << true << 1000;
+    if(hasLargeBenchmarks()){
+        QTest::newRow("adhoc SQL, 100k notes") << false << 100000;
+        QTest::newRow("prepared statements, 100k notes") << true << 100000;
+    }
+}
+
+/*!
+ * \brief tst_DBManager::benchmarkImport
+ * Compare the per-insert cost of the prepared statements owned by DBManager,
+ * one addNote per note in a single transaction, against the string built queries
+ * they replaced. The bulk load path is measured by benchmarkBulkImport
+ */
+void tst_DBManager::benchmarkImport()
+{
+    QFETCH(bool, prepared);
+    QFETCH(int, noteCount);
+
+    QString path = m_tempDir.path() + QStringLiteral("/import_%1.db").arg(prepared);
+    QFile::remove(path);
+
+    QList<NoteData*> noteList = generateNotes(noteCount, 256);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK_ONCE {
+        if(prepared){
+            QSqlDatabase::database().transaction();
+            for(NoteData* note : noteList)
+                dbManager->addNote(note);
+            QSqlDatabase::database().commit();
+        }else{
+            QSqlDatabase::database().transaction();
+            QSqlQuery query;
+            for(NoteData* note : noteList){
+                QString content = note->content().replace("'","''");
+                QString fullTitle = note->fullTitle().replace("'","''");
+                query.exec(QString("INSERT INTO active_notes "
+                                   "(creation_date, modification_date, deletion_date, full_title) "
+                                   "VALUES (%1, %2, -1, '%3');")
+                           .arg(note->creationDateTime().toMSecsSinceEpoch())
+                           .arg(note->lastModificationdateTime().toMSecsSinceEpoch())
+                           .arg(fullTitle));
+                query.exec(QString("INSERT INTO note_bodies (note_id, content) "
+                                   "VALUES (last_insert_rowid(), '%1');")
+                           .arg(content));
+            }
+            QSqlDatabase::database().commit();
+        }
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    qDebug() << "per insert:" << (elapsed / noteCount) / 1000.0 << "us";
+
+    QCOMPARE(dbManager->getAllNotes().count(), noteCount);
+
+    delete dbManager;
+    qDeleteAll(noteList);
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*!
+ * \brief tst_DBManager::testUpsertFallback
+ * Without UPSERT a note is updated in place, or inserted with its own id
+ * when it isn't stored yet, never given a new one
+ */
+void tst_DBManager::testUpsertFallback()
+{
+    QString path = m_tempDir.path() + QStringLiteral("/upsert.db");
+    QFile::remove(path);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+    dbManager->m_isUpsertSupported = false;
+
+    QList<NoteData*> noteList = generateNotes(1, 16);
+    NoteData* note = noteList.first();
+    note->setId(42);
+    QCOMPARE(dbManager->upsertNote(note), 1);
+
+    note->setContent(QStringLiteral("Edited content"));
+    note->setLastModificationDateTime(note->lastModificationdateTime().addSecs(60));
+    QCOMPARE(dbManager->upsertNote(note), 1);
+
+    QList<NoteData*> storedList = dbManager->getAllNotes();
+    QCOMPARE(storedList.count(), 1);
+    QCOMPARE(storedList.first()->id(), 42);
+    QCOMPARE(dbManager->getNoteContent(42), QStringLiteral("Edited content"));
+    qDeleteAll(storedList);
+
+    delete dbManager;
+    qDeleteAll(noteList);
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*!
+ * \brief tst_DBManager::testFailedSave
+ * A note whose body can't be written keeps its stored row and body,
+ * and its queued save is reported as failed and kept for the next flush
+ */
+void tst_DBManager::testFailedSave()
+{
+    QString path = m_tempDir.path() + QStringLiteral("/failed_save.db");
+    QFile::remove(path);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+
+    QList<NoteData*> noteList = generateNotes(1, 16);
+    NoteData* note = noteList.first();
+    note->setId(7);
+    QCOMPARE(dbManager->upsertNote(note), 1);
+    QString storedTitle = note->fullTitle();
+    QString storedContent = note->content();
+
+    QSqlQuery query;
+    QVERIFY(query.exec("CREATE TEMP TRIGGER fail_body_update BEFORE UPDATE ON note_bodies "
+                       "BEGIN SELECT RAISE(ABORT, 'disk full'); END"));
+
+    note->setFullTitle(QStringLiteral("Edited title"));
+    note->setContent(QStringLiteral("Edited title\nedited body"));
+    note->setLastModificationDateTime(note->lastModificationdateTime().addSecs(60));
+    QCOMPARE(dbManager->upsertNote(note), 0);
+
+    QList<NoteData*> storedList = dbManager->getAllNotes();
+    QCOMPARE(storedList.count(), 1);
+    QCOMPARE(storedList.first()->fullTitle(), storedTitle);
+    QCOMPARE(dbManager->getNoteContent(7), storedContent);
+    qDeleteAll(storedList);
+
+    QSignalSpy savedSpy(dbManager, SIGNAL(notesSaved(QList<int>,QList<qint64>)));
+    QSignalSpy failedSpy(dbManager, SIGNAL(notesSaveFailed(QList<int>)));
+    NoteData* queuedNote = new NoteData();
+    queuedNote->setId(7);
+    queuedNote->setCreationDate(note->creationDate());
+    queuedNote->setLastModificationDate(note->lastModificationDate());
+    queuedNote->setFullTitle(note->fullTitle());
+    queuedNote->setContent(note->content());
+    dbManager->onCreateUpdateRequested(queuedNote);
+    dbManager->flushPendingSaves();
+    QCOMPARE(failedSpy.count(), 1);
+    QCOMPARE(failedSpy.at(0).at(0).value<QList<int>>(), QList<int>() << 7);
+    QVERIFY(savedSpy.at(0).at(0).value<QList<int>>().isEmpty());
+    QVERIFY(dbManager->m_pendingSaves.contains(7));
+
+    QVERIFY(query.exec("DROP TRIGGER fail_body_update"));
+    dbManager->flushPendingSaves();
+    QCOMPARE(failedSpy.count(), 1);
+    QCOMPARE(savedSpy.at(1).at(0).value<QList<int>>(), QList<int>() << 7);
+    QVERIFY(dbManager->m_pendingSaves.isEmpty());
+    QCOMPARE(dbManager->getNoteContent(7), note->content());
+
+    delete dbManager;
+    qDeleteAll(noteList);
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*!
+ * \brief tst_DBManager::testLegacySchemaMigration
+ * A database created before the schema was versioned is brought
+ * to the current version, and its notes are searchable once
+ * the full text index backfill is over
+ */
+void tst_DBManager::testLegacySchemaMigration()
+{
+    QString path = m_tempDir.path() + QStringLiteral("/legacy.db");
+    QFile::remove(path);
+
+    {
+        QSqlDatabase legacy = QSqlDatabase::addDatabase(QStringLiteral("QSQLITE"), QStringLiteral("legacy"));
+        legacy.setDatabaseName(path);
+        QVERIFY(legacy.open());
+
+        QSqlQuery query(legacy);
+        QVERIFY(query.exec("CREATE TABLE active_notes (id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                           "creation_date INTEGER NOT NULL DEFAULT (0),"
+                           "modification_date INTEGER NOT NULL DEFAULT (0),"
+                           "deletion_date INTEGER NOT NULL DEFAULT (0),"
+                           "content TEXT, full_title TEXT)"));
+        QVERIFY(query.exec("CREATE UNIQUE INDEX active_index on active_notes (id ASC)"));
+        QVERIFY(query.exec("CREATE TABLE deleted_notes (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+                           "creation_date INTEGER NOT NULL DEFAULT (0),"
+                           "modification_date INTEGER NOT NULL DEFAULT (0),"
+                           "deletion_date INTEGER NOT NULL DEFAULT (0),"
+                           "content TEXT, full_title TEXT)"));
+        for(int i = 1; i <= 5000; ++i){
+            QVERIFY(query.exec(QStringLiteral("INSERT INTO active_notes (content, full_title) "
+                                              "VALUES ('note %1 body', 'note %1')").arg(i)));
+        }
+        QVERIFY(query.exec("INSERT INTO active_notes (content, full_title) VALUES ('needle', 'needle')"));
+        legacy.close();
+    }
+    QSqlDatabase::removeDatabase(QStringLiteral("legacy"));
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+
+    QSqlQuery query;
+    QVERIFY(query.exec("PRAGMA user_version"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 8);
+    query.finish();
+
+    QVERIFY(query.exec("SELECT COUNT(*) FROM note_bodies"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 5001);
+    query.finish();
+
+    // notes added while the backfill is pending are indexed by writeNoteBody,
+    // their ids are past the range left to the backfill
+    NoteData* note = new NoteData();
+    note->setCreationDateTime(QDateTime::currentDateTime());
+    note->setFullTitle(QStringLiteral("needle again"));
+    note->setContent(QStringLiteral("needle again"));
+    QVERIFY(dbManager->addNote(note));
+    delete note;
+
+    QTRY_VERIFY(dbManager->m_isFullTextSearchAvailable);
+    QCOMPARE(dbManager->searchNotes(QStringLiteral("needle")).count(), 2);
+    QCOMPARE(dbManager->searchNotes(QStringLiteral("note 4999")).count(), 1);
+
+    // without the full text index the bodies are scanned, with the case folded beyond ASCII
+    note = new NoteData();
+    note->setCreationDateTime(QDateTime::currentDateTime());
+    note->setFullTitle(QStringLiteral("\u00c9t\u00e9 \u00e0 Z\u00fcrich"));
+    note->setContent(QStringLiteral("\u00c9t\u00e9 \u00e0 Z\u00fcrich"));
+    QVERIFY(dbManager->addNote(note));
+    delete note;
+    QCOMPARE(DBManager::searchNotes(QSqlDatabase::database(), QStringLiteral("\u00c9T\u00c9 \u00c0 Z\u00dcRICH"), false).count(), 1);
+    QCOMPARE(DBManager::searchNotes(QSqlDatabase::database(), QStringLiteral("needle"), false).count(), 2);
+
+    delete dbManager;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+void tst_DBManager::benchmarkRevisionHistory_data()
+{
+    QTest::addColumn<int>("noteSize");
+    QTest::addColumn<int>("saveCount");
+
+    QTest::newRow("64 KB note, 100 saves") << 64 * 1024 << 100;
+    if(hasLargeBenchmarks())
+        QTest::newRow("1 MB note, 1000 saves") << 1024 * 1024 << 1000;
+}
+
+/*!
+ * \brief tst_DBManager::benchmarkRevisionHistory
+ * Save a large note many times with a small edit each time,
+ * the revisions have to stay about the size of the edits
+ * and any of them has to be rebuilt from the history
+ */
+void tst_DBManager::benchmarkRevisionHistory()
+{
+    QFETCH(int, noteSize);
+    QFETCH(int, saveCount);
+
+    const int editSize = 32;
+
+    QString path = m_tempDir.path() + QStringLiteral("/revisions.db");
+    QFile::remove(path);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+
+    const QStringList words = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                               "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"};
+    QString content;
+    content.reserve(noteSize + 16);
+    quint32 seed = 1;
+    while(content.size() < noteSize){
+        seed = seed * 1103515245 + 12345;
+        content += words.at((seed >> 16) % words.size());
+        content += ((seed >> 8) % 10 == 0) ? QLatin1Char('\n') : QLatin1Char(' ');
+    }
+
+    NoteData* note = new NoteData();
+    note->setId(1);
+    note->setCreationDateTime(QDateTime::currentDateTime());
+    note->setLastModificationDateTime(note->creationDateTime());
+    note->setFullTitle(QStringLiteral("revisions"));
+    note->setContent(content);
+    QCOMPARE(dbManager->upsertNote(note), 1);
+
+    QString middleContent;
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK_ONCE {
+        for(int i = 1; i <= saveCount; ++i){
+            seed = seed * 1103515245 + 12345;
+            int position = int((seed >> 4) % quint32(content.size() - editSize));
+            content.replace(position, editSize / 2, QStringLiteral("edit %1 ").arg(i).leftJustified(editSize, '-'));
+            if(i == saveCount / 2)
+                middleContent = content;
+
+            note->setContent(content);
+            note->setLastModificationDateTime(note->creationDateTime().addSecs(i));
+            QSqlDatabase::database().transaction();
+            QCOMPARE(dbManager->upsertNote(note), 1);
+            QSqlDatabase::database().commit();
+        }
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+    qDebug() << "per save:" << (elapsed / saveCount) / 1000.0 << "us";
+
+    QSqlQuery query;
+    QVERIFY(query.exec("SELECT COUNT(*), SUM(is_snapshot), SUM(length(data)) FROM note_revisions"));
+    QVERIFY(query.next());
+    int revisionCount = query.value(0).toInt();
+    qint64 storedSize = query.value(2).toLongLong();
+    qDebug() << "revisions:" << revisionCount << "snapshots:" << query.value(1).toInt()
+             << "stored:" << storedSize << "bytes," << storedSize / saveCount << "bytes per save";
+    query.finish();
+
+    QCOMPARE(revisionCount, saveCount + 1);
+    QVERIFY(storedSize < noteSize * 2);
+
+    timer.restart();
+    QCOMPARE(dbManager->getNoteRevision(1, saveCount), content);
+    qDebug() << "rebuild last revision:" << timer.elapsed() << "ms";
+    QCOMPARE(dbManager->getNoteRevision(1, saveCount / 2), middleContent);
+
+    delete note;
+    delete dbManager;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+void tst_DBManager::benchmarkBodyCompression_data()
+{
+    QTest::addColumn<int>("compression");
+
+    QTest::newRow("no compression") << int(DBManager::BodyCompression::None);
+    QTest::newRow("zlib") << int(DBManager::BodyCompression::Zlib);
+#ifdef NOTES_WITH_ZSTD
+    QTest::newRow("zstd") << int(DBManager::BodyCompression::Zstd);
+#endif
+}
+
+/*!
+ * \brief tst_DBManager::benchmarkBodyCompression
+ * Store large log like notes and compare the size of the database,
+ * the latency of a save and the time to load the notes back
+ * with each body compression
+ */
+void tst_DBManager::benchmarkBodyCompression()
+{
+    QFETCH(int, compression);
+
+    const int noteCount = 50;
+    const int lineCount = 20000;
+
+    QString path = m_tempDir.path() + QStringLiteral("/compression_%1.db").arg(compression);
+    QFile::remove(path);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->setBodyCompression(DBManager::BodyCompression(compression));
+    dbManager->open(path);
+
+    QDateTime dateTime = QDateTime::currentDateTime();
+    QList<NoteData*> noteList;
+    for(int i = 0; i < noteCount; ++i){
+        QString content = QStringLiteral("Log %1\n").arg(i);
+        for(int line = 0; line < lineCount; ++line){
+            content += QStringLiteral("%1 [worker-%2] INFO request %3 served in %4 ms\n")
+                    .arg(dateTime.addMSecs(line * 37).toString(Qt::ISODate))
+                    .arg(line % 8).arg(i * lineCount + line).arg((line * 7919) % 500);
+        }
+
+        NoteData* note = new NoteData();
+        note->setId(i + 1);
+        note->setCreationDateTime(dateTime);
+        note->setLastModificationDateTime(dateTime);
+        note->setFullTitle(QStringLiteral("Log %1").arg(i));
+        note->setContent(content);
+        noteList.append(note);
+    }
+
+    QElapsedTimer timer;
+    qint64 saveTime = 0;
+    QBENCHMARK_ONCE {
+        for(NoteData* note : noteList){
+            timer.start();
+            QSqlDatabase::database().transaction();
+            QCOMPARE(dbManager->upsertNote(note), 1);
+            QSqlDatabase::database().commit();
+            saveTime += timer.nsecsElapsed();
+        }
+    }
+    dbManager->checkpointWal(true);
+
+    timer.start();
+    for(NoteData* note : noteList)
+        QCOMPARE(dbManager->getNoteContent(note->id()), note->content());
+    qint64 loadTime = timer.nsecsElapsed();
+
+    qDebug() << "database size:" << QFileInfo(path).size() / 1024 << "KiB,"
+             << "save:" << (saveTime / noteCount) / 1000 << "us,"
+             << "load:" << (loadTime / noteCount) / 1000 << "us per note";
+
+    qDeleteAll(noteList);
+    delete dbManager;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*!
+ * \brief tst_DBManager::testBackupFile
+ * Export to a version 2 backup, read a single note back through its index,
+ * and import both a version 2 and a version 1 backup.
+ * Importing notes already stored skips or merges them
+ */
+void tst_DBManager::testBackupFile()
+{
+    const int noteCount = 1000;
+
+    QString path = m_tempDir.path() + QStringLiteral("/backup.db");
+    QString backupV1 = m_tempDir.path() + QStringLiteral("/notes_v1.nbk");
+    QString backupV2 = m_tempDir.path() + QStringLiteral("/notes_v2.nbk");
+    QFile::remove(path);
+
+    QList<NoteData*> noteList = generateNotes(noteCount, 2048);
+
+    QFile fileV1(backupV1);
+    QVERIFY(fileV1.open(QIODevice::WriteOnly));
+    QDataStream out(&fileV1);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+    out.setVersion(QDataStream::Qt_5_6);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 4, 0)
+    out.setVersion(QDataStream::Qt_5_4);
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 2, 0)
+    out.setVersion(QDataStream::Qt_5_2);
+#endif
+    out << noteList;
+    fileV1.close();
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+    dbManager->onImportNotesRequested(noteList);
+    QSignalSpy exportedSpy(dbManager, SIGNAL(jobFinished(bool)));
+    dbManager->onExportNotesRequested(backupV2);
+    dbManager->m_readerPool->waitForDone();
+    QCOMPARE(exportedSpy.count(), 1);
+    QCOMPARE(exportedSpy.at(0).at(0).toBool(), true);
+
+    QFile fileV2(backupV2);
+    QVERIFY(fileV2.open(QIODevice::ReadOnly));
+    NoteBackupReader reader(&fileV2);
+    QCOMPARE(reader.version(), 2);
+    QCOMPARE(reader.noteCount(), noteCount);
+
+    NoteData* note = reader.readNote(noteCount / 3);
+    QVERIFY(note != Q_NULLPTR);
+    QCOMPARE(note->content(), noteList.at(noteCount / 3 - 1)->content());
+    QCOMPARE(note->lastModificationdateTime(), noteList.at(noteCount / 3 - 1)->lastModificationdateTime());
+    delete note;
+    QVERIFY(reader.readNote(noteCount + 1) == Q_NULLPTR);
+    fileV2.close();
+
+    dbManager->onRestoreNotesFileRequested(backupV2);
+    QCOMPARE(dbManager->getAllNotes().count(), noteCount);
+
+    QSignalSpy importedSpy(dbManager, SIGNAL(importFinished(int,int,int)));
+    QSignalSpy importedNotesSpy(dbManager, SIGNAL(notesImported(QList<NoteData*>)));
+    dbManager->onImportNotesFileRequested(backupV1);
+    QCOMPARE(dbManager->getAllNotes().count(), noteCount);
+    QCOMPARE(importedSpy.count(), 1);
+    QCOMPARE(importedSpy.at(0).at(0).toInt(), 0);
+    QCOMPARE(importedSpy.at(0).at(1).toInt(), noteCount);
+    QCOMPARE(importedSpy.at(0).at(2).toInt(), 0);
+    QCOMPARE(importedNotesSpy.count(), 1);
+    QVERIFY(importedNotesSpy.at(0).at(0).value<QList<NoteData*>>().isEmpty());
+
+    // a copy edited later only moves the modification date of the stored note
+    NoteData* editedCopy = new NoteData();
+    editedCopy->setCreationDateTime(noteList.at(4)->creationDateTime());
+    editedCopy->setLastModificationDateTime(noteList.at(4)->lastModificationdateTime().addDays(1));
+    editedCopy->setFullTitle(noteList.at(4)->fullTitle());
+    editedCopy->setContent(noteList.at(4)->content());
+    dbManager->onImportNotesRequested(QList<NoteData*>() << editedCopy);
+    QCOMPARE(dbManager->getAllNotes().count(), noteCount);
+    QCOMPARE(importedSpy.count(), 2);
+    QCOMPARE(importedSpy.at(1).at(0).toInt(), 0);
+    QCOMPARE(importedSpy.at(1).at(2).toInt(), 1);
+    QList<NoteData*> storedList = dbManager->getAllNotes();
+    auto stored = std::find_if(storedList.constBegin(), storedList.constEnd(), [editedCopy](NoteData* storedNote){
+        return storedNote->fullTitle() == editedCopy->fullTitle();
+    });
+    QVERIFY(stored != storedList.constEnd());
+    QCOMPARE((*stored)->lastModificationdateTime(), editedCopy->lastModificationdateTime());
+    QCOMPARE((*stored)->creationDateTime(), editedCopy->creationDateTime());
+    // the merged note is handed over for the notes list to update its row
+    QList<NoteData*> mergedList = importedNotesSpy.at(1).at(0).value<QList<NoteData*>>();
+    QCOMPARE(mergedList.count(), 1);
+    QCOMPARE(mergedList.first()->id(), (*stored)->id());
+    QCOMPARE(mergedList.first()->lastModificationdateTime(), editedCopy->lastModificationdateTime());
+    qDeleteAll(mergedList);
+    qDeleteAll(storedList);
+    delete editedCopy;
+
+    // a cancelled restore leaves the notes as they were
+    QSignalSpy finishedSpy(dbManager, SIGNAL(jobFinished(bool)));
+    QMetaObject::Connection cancelOnProgress = connect(dbManager, &DBManager::jobProgress, [dbManager](){
+        dbManager->cancelJob();
+    });
+    dbManager->onRestoreNotesFileRequested(backupV2);
+    disconnect(cancelOnProgress);
+    QCOMPARE(finishedSpy.count(), 1);
+    QCOMPARE(finishedSpy.at(0).at(0).toBool(), false);
+    QCOMPARE(dbManager->getAllNotes().count(), noteCount);
+
+    qDeleteAll(noteList);
+    delete dbManager;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+void tst_DBManager::benchmarkBulkImport_data()
+{
+    QTest::addColumn<bool>("fromFile");
+    QTest::addColumn<int>("noteCount");
+
+    QTest::newRow("note list, 1k notes") << false << 1000;
+    QTest::newRow("backup file, 1k notes") << true << 1000;
+    if(hasLargeBenchmarks()){
+        QTest::newRow("note list, 100k notes") << false << 100000;
+        QTest::newRow("backup file, 1M notes") << true << 1000000;
+    }
+}
+
+/*!
+ * \brief tst_DBManager::benchmarkBulkImport
+ * Import small notes through the bulk load path, from a list of notes
+ * and from a backup file, the indexes are rebuilt once the notes are in
+ */
+void tst_DBManager::benchmarkBulkImport()
+{
+    QFETCH(bool, fromFile);
+    QFETCH(int, noteCount);
+
+    QString path = m_tempDir.path() + QStringLiteral("/bulk_%1.db").arg(fromFile);
+    QString backup = m_tempDir.path() + QStringLiteral("/bulk.nbk");
+    QFile::remove(path);
+
+    QList<NoteData*> noteList;
+    QDateTime dateTime = QDateTime::currentDateTime();
+    if(fromFile){
+        QFile file(backup);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        NoteBackupWriter writer(&file, false);
+        NoteData note;
+        note.setCreationDateTime(dateTime);
+        for(int i = 1; i <= noteCount; ++i){
+            note.setId(i);
+            note.setLastModificationDateTime(dateTime.addSecs(i));
+            note.setFullTitle(QStringLiteral("Note %1").arg(i));
+            note.setContent(QStringLiteral("Note %1\nbulk body of note %1").arg(i));
+            QVERIFY(writer.writeNote(&note));
+        }
+        QVERIFY(writer.finish());
+        file.close();
+    }else{
+        noteList.reserve(noteCount);
+        for(int i = 1; i <= noteCount; ++i){
+            NoteData* note = new NoteData();
+            note->setCreationDateTime(dateTime);
+            note->setLastModificationDateTime(dateTime.addSecs(i));
+            note->setFullTitle(QStringLiteral("Note %1").arg(i));
+            note->setContent(QStringLiteral("Note %1\nbulk body of note %1").arg(i));
+            noteList.append(note);
+        }
+    }
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+    QTRY_VERIFY(dbManager->m_isFullTextSearchAvailable);
+
+    QSignalSpy finishedSpy(dbManager, SIGNAL(jobFinished(bool)));
+    QElapsedTimer timer;
+    timer.start();
+
+    QBENCHMARK_ONCE {
+        if(fromFile)
+            dbManager->onImportNotesFileRequested(backup);
+        else
+            dbManager->onImportNotesRequested(noteList);
+    }
+
+    qDebug() << "notes per second:" << noteCount * 1000.0 / qMax<qint64>(1, timer.elapsed());
+
+    if(fromFile){
+        QCOMPARE(finishedSpy.count(), 1);
+        QCOMPARE(finishedSpy.at(0).at(0).toBool(), true);
+    }
+
+    QSqlQuery query;
+    QVERIFY(query.exec("SELECT COUNT(*) FROM active_notes"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), noteCount);
+    query.finish();
+
+    QVERIFY(query.exec("SELECT COUNT(*) FROM sqlite_master WHERE name = 'active_notes_modification_index'"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 1);
+    query.finish();
+
+    QCOMPARE(dbManager->searchNotes(QStringLiteral("note %1").arg(noteCount * 7 / 9)).count(), 1);
+
+    delete dbManager;
+    qDeleteAll(noteList);
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*!
+ * \brief tst_DBManager::testTrashRetention
+ * Deleted notes past the retention age, then past the retention count,
+ * are purged oldest first and their pages given back to the file system
+ */
+void tst_DBManager::testTrashRetention()
+{
+    const int noteCount = 2000;
+
+    QString path = m_tempDir.path() + QStringLiteral("/trash.db");
+    QFile::remove(path);
+
+    QList<NoteData*> noteList = generateNotes(noteCount, 2048);
+
+    DBManager* dbManager = new DBManager;
+    dbManager->open(path);
+    QCOMPARE(dbManager->pragmaValue(QStringLiteral("auto_vacuum")), qint64(2));
+
+    dbManager->onImportNotesRequested(noteList);
+
+    QDateTime now = QDateTime::currentDateTime();
+    QSqlDatabase::database().transaction();
+    for(int i = 0; i < noteCount; ++i){
+        NoteData* note = noteList.at(i);
+        // the first three quarters were deleted a hundred days ago
+        note->setDeletionDateTime(i < noteCount * 3 / 4 ? now.addDays(-100).addSecs(i) : now.addSecs(-i));
+        QVERIFY(dbManager->removeNote(note));
+    }
+    QSqlDatabase::database().commit();
+
+    QSignalSpy purgedSpy(dbManager, SIGNAL(trashPurged(int,qint64)));
+    dbManager->setTrashRetention(30, 200);
+    dbManager->purgeTrashBatch();
+    QTRY_COMPARE(purgedSpy.count(), 1);
+
+    QCOMPARE(purgedSpy.at(0).at(0).toInt(), noteCount - 200);
+    QVERIFY(purgedSpy.at(0).at(1).toLongLong() > 0);
+    QCOMPARE(dbManager->pragmaValue(QStringLiteral("freelist_count")), qint64(0));
+
+    // the most recently deleted notes are the ones kept
+    QSqlQuery query;
+    QVERIFY(query.exec("SELECT COUNT(*), MIN(id) FROM deleted_notes"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 200);
+    QCOMPARE(query.value(1).toInt(), noteCount * 3 / 4 + 1);
+    query.finish();
+
+    qDeleteAll(noteList);
+    delete dbManager;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
@@ -0,0 +1,38 @@
+#ifndef TST_DBMANAGER_H
+#define TST_DBMANAGER_H
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+#include "../src/notedata.h"
+
+class tst_DBManager : public QObject
+{
+    Q_OBJECT
+public:
+    tst_DBManager();
+
+private:
+    QTemporaryDir m_tempDir;
+
+    bool hasLargeBenchmarks() const;
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void benchmarkImport_data();
+    void benchmarkImport();
+    void testUpsertFallback();
+    void testFailedSave();
+    void testLegacySchemaMigration();
+    void benchmarkRevisionHistory_data();
+    void benchmarkRevisionHistory();
+    void benchmarkBodyCompression_data();
+    void benchmarkBodyCompression();
+    void testBackupFile();
+    void benchmarkBulkImport_data();
+    void benchmarkBulkImport();
+    void testTrashRetention();
+};
+
+#endif // TST_DBMANAGER_H
@@ -0,0 +1,73 @@
+#include "tst_editjournal.h"
+#include "../src/editjournal.h"
+
+tst_EditJournal::tst_EditJournal()
+{
+
+}
+
+void tst_EditJournal::initTestCase()
+{
+    QVERIFY(m_tempDir.isValid());
+}
+
+void tst_EditJournal::cleanupTestCase()
+{
+
+}
+
+/*!
+ * \brief tst_EditJournal::testReplay
+ * Edits logged by a session that crashed are read back as the last state
+ * of each note, the notes saved since and a record cut short by the crash
+ * are dropped, and the journal is emptied once every edit is saved
+ */
+void tst_EditJournal::testReplay()
+{
+    QString path = m_tempDir.path() + QStringLiteral("/notes.journal");
+    QFile::remove(path);
+
+    qint64 created = QDateTime::currentMSecsSinceEpoch();
+    qint64 edited = created + 1000;
+
+    {
+        EditJournal journal;
+        QVERIFY(journal.open(path));
+        QVERIFY(journal.replay().isEmpty());
+
+        journal.logEdit(1, created, created, QStringLiteral("hello"));
+        journal.logEdit(1, created, edited, QStringLiteral("hello world"));
+
+        journal.logEdit(2, created, edited, QStringLiteral("removed"));
+        journal.logRemoval(2);
+
+        journal.logEdit(3, created, edited, QStringLiteral("saved"));
+        journal.markSaved({3}, {edited});
+    }
+
+    QFile file(path);
+    qint64 journalSize = file.size();
+    QVERIFY(journalSize > 0);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write(QByteArray("\x00\x00\x00\x40torn", 8));
+    file.close();
+
+    EditJournal journal;
+    QVERIFY(journal.open(path));
+    QList<NoteData*> noteList = journal.replay();
+    QCOMPARE(file.size(), journalSize);
+
+    // the saved note isn't replayed
+    QCOMPARE(noteList.size(), 1);
+    QCOMPARE(noteList.at(0)->id(), 1);
+    QCOMPARE(noteList.at(0)->content(), QStringLiteral("hello world"));
+    QCOMPARE(noteList.at(0)->creationDate(), created);
+    QCOMPARE(noteList.at(0)->lastModificationDate(), edited);
+    qDeleteAll(noteList);
+
+    journal.logEdit(4, created, edited, QStringLiteral("new"));
+    journal.markSaved({4}, {edited});
+    QVERIFY(file.size() > 0);
+    journal.markSaved({1}, {edited});
+    QCOMPARE(file.size(), qint64(0));
+}
@@ -0,0 +1,23 @@
+#ifndef TST_EDITJOURNAL_H
+#define TST_EDITJOURNAL_H
+
+#include <QObject>
+#include <QtTest>
+#include <QTemporaryDir>
+
+class tst_EditJournal : public QObject
+{
+    Q_OBJECT
+public:
+    tst_EditJournal();
+
+private:
+    QTemporaryDir m_tempDir;
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testReplay();
+};
+
+#endif // TST_EDITJOURNAL_H
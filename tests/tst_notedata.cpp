@@ -14,3 +14,29 @@ void tst_NoteData::cleanupTestCase()
 {
 
 }
+
+/*!
+ * \brief tst_NoteData::testDates
+ * Dates are kept as milliseconds since epoch, an unset date is -1
+ * and reads back as an invalid QDateTime
+ */
+void tst_NoteData::testDates()
+{
+    NoteData note;
+    QCOMPARE(note.creationDate(), qint64(-1));
+    QVERIFY(!note.lastModificationdateTime().isValid());
+
+    QDateTime dateTime = QDateTime::currentDateTime();
+    note.setCreationDateTime(dateTime);
+    note.setLastModificationDate(dateTime.toMSecsSinceEpoch() + 1000);
+    QCOMPARE(note.creationDate(), dateTime.toMSecsSinceEpoch());
+    QCOMPARE(note.lastModificationdateTime(), dateTime.addSecs(1));
+
+    NoteData* copy = note.clone();
+    QCOMPARE(copy->lastModificationDate(), note.lastModificationDate());
+    QCOMPARE(copy->deletionDate(), qint64(-1));
+    delete copy;
+
+    note.setDeletionDateTime(QDateTime());
+    QCOMPARE(note.deletionDate(), qint64(-1));
+}
@@ -14,7 +14,7 @@ public:
 private Q_SLOTS:
     void initTestCase();
     void cleanupTestCase();
-
+    void testDates();
 };
 
 #endif // TST_NOTEDATA_H
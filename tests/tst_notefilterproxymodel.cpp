@@ -0,0 +1,197 @@
+#include "tst_notefilterproxymodel.h"
+#include "../src/notemodel.h"
+#include "../src/notefilterproxymodel.h"
+#include "testnotes.h"
+#include <QElapsedTimer>
+
+#define BENCHMARK_NOTE_COUNT 50000
+
+tst_NoteFilterProxyModel::tst_NoteFilterProxyModel()
+{
+
+}
+
+/*!
+ * \brief tst_NoteFilterProxyModel::proxyIds
+ * \param proxy
+ * \return the ids of the notes shown, in order
+ */
+QList<int> tst_NoteFilterProxyModel::proxyIds(const NoteFilterProxyModel& proxy) const
+{
+    QList<int> ids;
+    for(int row = 0; row < proxy.rowCount(); ++row)
+        ids.append(proxy.index(row, 0).data(NoteModel::NoteID).toInt());
+    return ids;
+}
+
+void tst_NoteFilterProxyModel::initTestCase()
+{
+
+}
+
+void tst_NoteFilterProxyModel::cleanupTestCase()
+{
+
+}
+
+/*!
+ * \brief tst_NoteFilterProxyModel::testRefinement
+ * Narrowing results only remove rows, widening results test every note again,
+ * and each run of adjacent rows is reported once
+ */
+void tst_NoteFilterProxyModel::testRefinement()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(10));
+    NoteFilterProxyModel proxy;
+    proxy.setSourceModel(&model);
+    QCOMPARE(proxy.rowCount(), 10);
+    QVERIFY(!proxy.isFiltering());
+
+    QSignalSpy insertedSpy(&proxy, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    QSignalSpy removedSpy(&proxy, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+
+    proxy.setNoteIdFilter(QList<int>() << 8 << 1 << 2 << 3 << 5);
+    QVERIFY(proxy.isFiltering());
+    QCOMPARE(proxyIds(proxy), QList<int>() << 1 << 2 << 3 << 5 << 8);
+    QCOMPARE(removedSpy.count(), 3);
+    QCOMPARE(insertedSpy.count(), 0);
+
+    // the next keystroke narrows the results
+    removedSpy.clear();
+    proxy.setNoteIdFilter(QList<int>() << 2 << 5 << 8);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 2 << 5 << 8);
+    QCOMPARE(removedSpy.count(), 2);
+    QCOMPARE(removedSpy.at(0).at(1).toInt(), 2);
+    QCOMPARE(removedSpy.at(1).at(1).toInt(), 0);
+    QCOMPARE(proxy.mapToSource(proxy.index(1, 0)).row(), 4);
+    QVERIFY(!proxy.mapFromSource(model.index(2)).isValid());
+    QCOMPARE(proxy.mapFromSource(model.index(7)).row(), 2);
+
+    // a deleted character widens them again
+    removedSpy.clear();
+    proxy.setNoteIdFilter(QList<int>() << 2 << 4 << 5 << 8 << 9);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 2 << 4 << 5 << 8 << 9);
+    QCOMPARE(removedSpy.count(), 0);
+    QCOMPARE(insertedSpy.count(), 2);
+
+    proxy.setNoteIdFilter(QList<int>());
+    QCOMPARE(proxy.rowCount(), 0);
+
+    proxy.clearNoteIdFilter();
+    QVERIFY(!proxy.isFiltering());
+    QCOMPARE(proxy.rowCount(), 10);
+    QCOMPARE(insertedSpy.count(), 3);
+}
+
+/*!
+ * \brief tst_NoteFilterProxyModel::testSourceChanges
+ * Rows inserted, moved, removed or renumbered in the source model
+ * while searching are applied without filtering every note again
+ */
+void tst_NoteFilterProxyModel::testSourceChanges()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(10));
+    qint64 latest = model.data(model.index(0), NoteModel::NoteLastModificationDateTime).toLongLong();
+    NoteFilterProxyModel proxy;
+    proxy.setSourceModel(&model);
+    proxy.setNoteIdFilter(QList<int>() << 2 << 5 << 8 << 12);
+
+    auto makeNote = [](int id, qint64 modificationDate){
+        NoteData* note = new NoteData();
+        note->setId(id);
+        note->setCreationDate(modificationDate);
+        note->setLastModificationDate(modificationDate);
+        return note;
+    };
+
+    QSignalSpy insertedSpy(&proxy, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    QSignalSpy removedSpy(&proxy, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy movedSpy(&proxy, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    model.addNote(makeNote(11, latest + 1000));
+    QCOMPARE(insertedSpy.count(), 0);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 2 << 5 << 8);
+    QCOMPARE(proxy.mapToSource(proxy.index(0, 0)).row(), 2);
+
+    QVERIFY(model.setData(model.noteIndex(8), latest + 2000, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(movedSpy.count(), 1);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 2 << 5);
+
+    // a hidden note moving past the shown ones doesn't move them
+    QVERIFY(model.setData(model.noteIndex(1), latest + 3000, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(movedSpy.count(), 1);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 2 << 5);
+
+    delete model.removeNote(model.noteIndex(5));
+    QCOMPARE(removedSpy.count(), 1);
+    delete model.removeNote(model.noteIndex(3));
+    QCOMPARE(removedSpy.count(), 1);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 2);
+
+    model.addNote(makeNote(12, latest - 500));
+    QCOMPARE(insertedSpy.count(), 1);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 12 << 2);
+
+    // rows put out of order and sorted back keep the persistent indexes
+    QPersistentModelIndex selected = proxy.index(1, 0);
+    model.insertNote(makeNote(13, latest - 20000), 0);
+    QCOMPARE(selected.row(), 1);
+    model.sort(0, Qt::DescendingOrder);
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 12 << 2);
+    QCOMPARE(selected.data(NoteModel::NoteID).toInt(), 12);
+
+    QVERIFY(model.setData(model.noteIndex(12), 20, NoteModel::NoteID));
+    QCOMPARE(proxyIds(proxy), QList<int>() << 8 << 2);
+    QVERIFY(!selected.isValid());
+}
+
+/*!
+ * \brief tst_NoteFilterProxyModel::benchmarkSearchAsYouType
+ * The search results of a keyword typed one character at a time, each one matching
+ * half the notes of the previous one, then deleted. The proxy refines the rows shown
+ * because each result is a subset of the previous one, whatever the keywords were,
+ * it is compared against clearing the filter before each result
+ */
+void tst_NoteFilterProxyModel::benchmarkSearchAsYouType()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(BENCHMARK_NOTE_COUNT));
+    NoteFilterProxyModel refinedProxy;
+    refinedProxy.setSourceModel(&model);
+    NoteFilterProxyModel rescannedProxy;
+    rescannedProxy.setSourceModel(&model);
+
+    QList<QList<int>> keystrokeResults;
+    for(int step = 1; step <= 8; ++step){
+        QList<int> noteIdList;
+        for(int id = 1; id <= BENCHMARK_NOTE_COUNT; id += (1 << step))
+            noteIdList.append(id);
+        keystrokeResults.append(noteIdList);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for(const QList<int>& noteIdList : keystrokeResults)
+        refinedProxy.setNoteIdFilter(noteIdList);
+    qint64 refinedTime = timer.restart();
+
+    for(const QList<int>& noteIdList : keystrokeResults){
+        rescannedProxy.clearNoteIdFilter();
+        rescannedProxy.setNoteIdFilter(noteIdList);
+    }
+    qint64 rescannedTime = timer.restart();
+
+    for(int step = keystrokeResults.size() - 2; step >= 0; --step)
+        refinedProxy.setNoteIdFilter(keystrokeResults.at(step));
+    qint64 deletedTime = timer.elapsed();
+
+    qDebug() << keystrokeResults.size() << "keystrokes on" << BENCHMARK_NOTE_COUNT << "notes, refined:"
+             << refinedTime << "ms, cleared then filtered:" << rescannedTime << "ms,"
+             << keystrokeResults.size() - 1 << "deletions:" << deletedTime << "ms";
+
+    QCOMPARE(refinedProxy.rowCount(), keystrokeResults.first().size());
+    QCOMPARE(rescannedProxy.rowCount(), keystrokeResults.last().size());
+    QCOMPARE(proxyIds(rescannedProxy), keystrokeResults.last());
+}
@@ -0,0 +1,27 @@
+#ifndef TST_NOTEFILTERPROXYMODEL_H
+#define TST_NOTEFILTERPROXYMODEL_H
+
+#include <QObject>
+#include <QtTest>
+#include "../src/notedata.h"
+
+class NoteFilterProxyModel;
+
+class tst_NoteFilterProxyModel : public QObject
+{
+    Q_OBJECT
+public:
+    tst_NoteFilterProxyModel();
+
+private:
+    QList<int> proxyIds(const NoteFilterProxyModel& proxy) const;
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testRefinement();
+    void testSourceChanges();
+    void benchmarkSearchAsYouType();
+};
+
+#endif // TST_NOTEFILTERPROXYMODEL_H
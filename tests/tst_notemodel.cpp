@@ -1,4 +1,51 @@
 #include "tst_notemodel.h"
+#include "../src/notemodel.h"
+#include "testnotes.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <random>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define BENCHMARK_NOTE_COUNT 100000
+
+/*!
+ * \brief heapInUse
+ * \return the bytes allocated on the heap, -1 where it can't be measured
+ */
+static qint64 heapInUse()
+{
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+    return qint64(mallinfo2().uordblks);
+#else
+    return qint64(mallinfo().uordblks);
+#endif
+#else
+    return -1;
+#endif
+}
+
+/*!
+ * \brief The LegacyNote class
+ * A note as the notes list held it before the model stored its fields in arrays:
+ * one QObject per note, with its dates as QDateTime
+ */
+class LegacyNote : public QObject
+{
+public:
+    int id;
+    QString fullTitle;
+    QDateTime lastModificationDateTime;
+    QDateTime creationDateTime;
+    QDateTime deletionDateTime;
+    QString content;
+    bool isModified;
+    bool isSelected;
+    int scrollBarPosition;
+};
 
 tst_NoteModel::tst_NoteModel()
 {
@@ -14,3 +61,445 @@ void tst_NoteModel::cleanupTestCase()
 {
 
 }
+
+/*!
+ * \brief tst_NoteModel::testNoteStore
+ * Rows keep their fields together through inserts, moves, edits, sorting and removals
+ */
+void tst_NoteModel::testNoteStore()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(3));
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteID).toInt(), 2);
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteFullTitle).toString(), QStringLiteral("Note's title 1"));
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteDeletionDateTime).toLongLong(), qint64(-1));
+
+    NoteData* newNote = new NoteData();
+    newNote->setId(4);
+    newNote->setCreationDateTime(QDateTime::currentDateTime().addDays(1));
+    newNote->setLastModificationDateTime(newNote->creationDateTime());
+    newNote->setFullTitle(QStringLiteral("New Note"));
+    qint64 newNoteDate = newNote->creationDate();
+    QModelIndex newIndex = model.insertNote(newNote, 0);
+    QCOMPARE(newIndex.row(), 0);
+    QCOMPARE(model.data(newIndex, NoteModel::NoteID).toInt(), 4);
+    QCOMPARE(model.data(newIndex, NoteModel::NoteLastModificationDateTime).toLongLong(), newNoteDate);
+    QCOMPARE(model.data(newIndex, NoteModel::NoteContent).toString(), QString());
+
+    // titles growing one character at a time, as they do while typing
+    QString typedTitle;
+    for(int i = 0; i < 5000; ++i){
+        typedTitle.append(QChar('a' + i % 26));
+        QVERIFY(model.setData(newIndex, typedTitle, NoteModel::NoteFullTitle));
+    }
+    QVERIFY(model.setData(model.index(2), QStringLiteral("Short"), NoteModel::NoteFullTitle));
+    QCOMPARE(model.data(newIndex, NoteModel::NoteFullTitle).toString(), typedTitle);
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteFullTitle).toString(), QStringLiteral("Note's title 0"));
+    QCOMPARE(model.data(model.index(2), NoteModel::NoteFullTitle).toString(), QStringLiteral("Short"));
+    QVERIFY(model.m_titlePool.size() < typedTitle.size() * 3);
+
+    QVERIFY(model.moveRow(QModelIndex(), 3, QModelIndex(), 0));
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteID).toInt(), 3);
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteID).toInt(), 4);
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteFullTitle).toString(), QStringLiteral("Note's title 2"));
+
+    model.sort(0, Qt::AscendingOrder);
+    QList<int> sortedIds;
+    for(int row = 0; row < model.rowCount(); ++row)
+        sortedIds.append(model.data(model.index(row), NoteModel::NoteID).toInt());
+    QCOMPARE(sortedIds, QList<int>() << 4 << 1 << 2 << 3);
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteFullTitle).toString(), typedTitle);
+
+    QVERIFY(model.setData(model.index(1), QStringLiteral("Content of note 1"), NoteModel::NoteContent));
+    NoteData* removed = model.removeNote(model.index(1));
+    QCOMPARE(removed->id(), 1);
+    QCOMPARE(removed->fullTitle(), QStringLiteral("Note's title 0"));
+    QCOMPARE(removed->content(), QStringLiteral("Content of note 1"));
+    delete removed;
+    QCOMPARE(model.rowCount(), 3);
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteID).toInt(), 2);
+    QVERIFY(!model.m_contentCache.contains(1));
+}
+
+/*!
+ * \brief tst_NoteModel::testContentCache
+ * Contents are loaded when they are read and the least recently used
+ * ones are released past the capacity of the cache, except the edits
+ * the database doesn't have yet
+ */
+void tst_NoteModel::testContentCache()
+{
+    NoteModel model;
+    int loadCount = 0;
+    model.setContentLoader([&loadCount](int noteId){
+        ++loadCount;
+        return QString(100, QChar('a' + noteId));
+    });
+    model.setContentCacheCapacity(250);
+    model.addListNote(generateNotes(4));
+
+    for(int row = 0; row < 4; ++row)
+        QCOMPARE(model.data(model.index(row), NoteModel::NoteContent).toString(), QString(100, QChar('b' + row)));
+    QCOMPARE(loadCount, 4);
+    QCOMPARE(model.m_contentCache.size(), 2);
+    QVERIFY(model.m_contentCacheSize <= 250);
+
+    // the most recent contents are still cached, the oldest one is loaded again
+    model.data(model.index(3), NoteModel::NoteContent);
+    QCOMPARE(loadCount, 4);
+    model.data(model.index(0), NoteModel::NoteContent);
+    QCOMPARE(loadCount, 5);
+
+    NoteData* note = model.getNote(model.index(1));
+    QCOMPARE(note->content(), QString(100, QChar('c')));
+    delete note;
+    QCOMPARE(loadCount, 6);
+
+    // the edits stay cached past the capacity until the database has them
+    for(int row = 0; row < 3; ++row)
+        QVERIFY(model.setData(model.index(row), QString(100, QChar('x')), NoteModel::NoteContent));
+    model.data(model.index(3), NoteModel::NoteContent);
+    QCOMPARE(loadCount, 7);
+    QCOMPARE(model.m_contentCache.size(), 4);
+
+    // the second note was edited again after the save
+    qint64 firstSaved = model.data(model.index(0), NoteModel::NoteLastModificationDateTime).toLongLong();
+    qint64 secondSaved = model.data(model.index(1), NoteModel::NoteLastModificationDateTime).toLongLong() - 1;
+    model.markContentSaved(QList<int>() << 1 << 2, QList<qint64>() << firstSaved << secondSaved);
+    QCOMPARE(model.m_contentCache.size(), 3);
+    QVERIFY(!model.m_contentCache.contains(1));
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteContent).toString(), QString(100, QChar('x')));
+    QCOMPARE(loadCount, 7);
+}
+
+/*!
+ * \brief tst_NoteModel::testSortedInsertion
+ * Notes added or edited go where their modification date puts them,
+ * with one rowsInserted per run of new rows and one rowsMoved per edit
+ */
+void tst_NoteModel::testSortedInsertion()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(5));
+    qint64 latest = model.data(model.index(0), NoteModel::NoteLastModificationDateTime).toLongLong();
+
+    auto makeNote = [](int id, qint64 modificationDate){
+        NoteData* note = new NoteData();
+        note->setId(id);
+        note->setCreationDate(modificationDate);
+        note->setLastModificationDate(modificationDate);
+        note->setFullTitle(QStringLiteral("Imported %1").arg(id));
+        return note;
+    };
+    auto rowIds = [&model](){
+        QList<int> ids;
+        for(int row = 0; row < model.rowCount(); ++row)
+            ids.append(model.data(model.index(row), NoteModel::NoteID).toInt());
+        return ids;
+    };
+
+    QSignalSpy insertedSpy(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    QSignalSpy movedSpy(&model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    QSignalSpy changedSpy(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+
+    model.addListNote(QList<NoteData*>() << makeNote(13, latest - 10000) << makeNote(11, latest - 1500)
+                                         << makeNote(10, latest + 1000) << makeNote(12, latest - 1700));
+    QCOMPARE(rowIds(), QList<int>() << 10 << 1 << 2 << 11 << 12 << 3 << 4 << 5 << 13);
+    QCOMPARE(insertedSpy.count(), 3);
+    QCOMPARE(insertedSpy.at(1).at(1).toInt(), 3);
+    QCOMPARE(insertedSpy.at(1).at(2).toInt(), 4);
+    QCOMPARE(model.data(model.index(3), NoteModel::NoteFullTitle).toString(), QStringLiteral("Imported 11"));
+
+    QVERIFY(model.setData(model.index(7), latest + 2000, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(rowIds(), QList<int>() << 5 << 10 << 1 << 2 << 11 << 12 << 3 << 4 << 13);
+    QCOMPARE(movedSpy.count(), 1);
+    QCOMPARE(changedSpy.last().at(0).value<QModelIndex>().row(), 0);
+
+    QVERIFY(model.setData(model.index(0), latest - 1600, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(rowIds(), QList<int>() << 10 << 1 << 2 << 11 << 5 << 12 << 3 << 4 << 13);
+    QCOMPARE(movedSpy.count(), 2);
+    QCOMPARE(model.data(model.index(4), NoteModel::NoteFullTitle).toString(), QStringLiteral("Note's title 4"));
+
+    // a date that keeps the note between its neighbours doesn't move it
+    QVERIFY(model.setData(model.index(4), latest - 1550, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(movedSpy.count(), 2);
+
+    QModelIndex added = model.addNote(makeNote(14, latest - 2500));
+    QCOMPARE(added.row(), 7);
+    QCOMPARE(model.noteIndex(14), added);
+    QVERIFY(!model.noteIndex(99).isValid());
+    QCOMPARE(insertedSpy.count(), 4);
+
+    // the lookups follow the moves, the new ids and the removals
+    QVERIFY(model.setData(model.index(9), latest + 3000, NoteModel::NoteLastModificationDateTime));
+    QCOMPARE(model.noteIndex(13).row(), 0);
+    QCOMPARE(model.noteIndex(5).row(), 5);
+    QCOMPARE(model.noteIndex(4).row(), 9);
+    QVERIFY(model.setData(model.index(5), 15, NoteModel::NoteID));
+    QVERIFY(!model.noteIndex(5).isValid());
+    QCOMPARE(model.noteIndex(15).row(), 5);
+    delete model.removeNote(model.index(9));
+    QVERIFY(!model.noteIndex(4).isValid());
+    QCOMPARE(model.noteIndex(14).row(), 8);
+}
+
+/*!
+ * \brief tst_NoteModel::testBatchUpdates
+ * Setting several roles of a note, or the roles of several notes,
+ * notifies the views once per run of updated rows with every role set
+ */
+void tst_NoteModel::testBatchUpdates()
+{
+    NoteModel model;
+    model.addListNote(generateNotes(6));
+    qint64 latest = model.data(model.index(0), NoteModel::NoteLastModificationDateTime).toLongLong();
+
+    QSignalSpy changedSpy(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+    QSignalSpy movedSpy(&model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+
+    // a keystroke in the editor
+    QMap<int, QVariant> dataValue;
+    dataValue[NoteModel::NoteContent] = QStringLiteral("Edited\ncontent");
+    dataValue[NoteModel::NoteFullTitle] = QStringLiteral("Edited");
+    dataValue[NoteModel::NoteLastModificationDateTime] = latest + 1000;
+    QVERIFY(model.setItemData(model.index(3), dataValue));
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(movedSpy.count(), 1);
+    QCOMPARE(changedSpy.at(0).at(0).value<QModelIndex>().row(), 0);
+    QCOMPARE(changedSpy.at(0).at(2).value<QVector<int>>().size(), 3);
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteID).toInt(), 4);
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteFullTitle).toString(), QStringLiteral("Edited"));
+    QCOMPARE(model.data(model.index(0), NoteModel::NoteContent).toString(), QStringLiteral("Edited\ncontent"));
+
+    // an unknown role is skipped, the others are still set
+    dataValue.clear();
+    dataValue[NoteModel::NoteScrollbarPos] = 12;
+    dataValue[Qt::DisplayRole] = QStringLiteral("Ignored");
+    QVERIFY(!model.setItemData(model.index(1), dataValue));
+    QCOMPARE(model.data(model.index(1), NoteModel::NoteScrollbarPos).toInt(), 12);
+    QCOMPARE(changedSpy.count(), 2);
+
+    changedSpy.clear();
+    QHash<int, QMap<int, QVariant>> notesData;
+    notesData[2][NoteModel::NoteScrollbarPos] = 5;
+    notesData[3][NoteModel::NoteScrollbarPos] = 6;
+    notesData[6][NoteModel::NoteCreationDateTime] = latest - 20000;
+    QVERIFY(model.setNotesData(notesData));
+    QCOMPARE(changedSpy.count(), 2);
+    QCOMPARE(changedSpy.at(0).at(0).value<QModelIndex>().row(), 2);
+    QCOMPARE(changedSpy.at(0).at(1).value<QModelIndex>().row(), 3);
+    QCOMPARE(changedSpy.at(1).at(0).value<QModelIndex>().row(), 5);
+    QCOMPARE(changedSpy.at(0).at(2).value<QVector<int>>().size(), 2);
+    QCOMPARE(model.data(model.index(3), NoteModel::NoteScrollbarPos).toInt(), 6);
+
+    // a few modification dates move their rows, the others stay in place
+    changedSpy.clear();
+    QSignalSpy layoutSpy(&model, SIGNAL(layoutChanged()));
+    QPersistentModelIndex selected = model.index(2);
+    notesData.clear();
+    notesData[6][NoteModel::NoteLastModificationDateTime] = latest + 3000;
+    notesData[5][NoteModel::NoteLastModificationDateTime] = latest + 2000;
+    notesData[99][NoteModel::NoteLastModificationDateTime] = latest;
+    QVERIFY(!model.setNotesData(notesData));
+    QCOMPARE(layoutSpy.count(), 0);
+    QCOMPARE(movedSpy.count(), 3);
+    QCOMPARE(changedSpy.count(), 1);
+    QCOMPARE(changedSpy.at(0).at(0).value<QModelIndex>().row(), 0);
+    QCOMPARE(changedSpy.at(0).at(1).value<QModelIndex>().row(), 1);
+    QList<int> ids;
+    for(int row = 0; row < model.rowCount(); ++row)
+        ids.append(model.data(model.index(row), NoteModel::NoteID).toInt());
+    QCOMPARE(ids, QList<int>() << 6 << 5 << 4 << 1 << 2 << 3);
+    QCOMPARE(selected.row(), 4);
+
+    // past REORDER_MOVES_MAX notes the rows are sorted once for the whole batch
+    NoteModel largeModel;
+    largeModel.addListNote(generateNotes(100));
+    QSignalSpy largeLayoutSpy(&largeModel, SIGNAL(layoutChanged()));
+    QSignalSpy largeMovedSpy(&largeModel, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)));
+    notesData.clear();
+    for(int id = 1; id <= 100; ++id)
+        notesData[id][NoteModel::NoteLastModificationDateTime] = latest + id;
+    QVERIFY(largeModel.setNotesData(notesData));
+    QCOMPARE(largeLayoutSpy.count(), 1);
+    QCOMPARE(largeMovedSpy.count(), 0);
+    for(int row = 0; row < largeModel.rowCount(); ++row)
+        QCOMPARE(largeModel.data(largeModel.index(row), NoteModel::NoteID).toInt(), 100 - row);
+}
+
+/*!
+ * \brief tst_NoteModel::benchmarkMemory
+ * Heap used by the notes list as one NoteData object per note,
+ * then by the same notes in the model
+ */
+void tst_NoteModel::benchmarkMemory()
+{
+    if(heapInUse() < 0)
+        QSKIP("the heap can't be measured on this platform");
+
+    qint64 heapBefore = heapInUse();
+    QList<NoteData*> noteList = generateNotes(BENCHMARK_NOTE_COUNT);
+    qint64 objectBytes = heapInUse() - heapBefore;
+
+    NoteModel* model = new NoteModel;
+    model->addListNote(noteList);
+    qint64 storeBytes = heapInUse() - heapBefore;
+
+    qDebug() << "bytes per note, objects:" << objectBytes / BENCHMARK_NOTE_COUNT
+             << "model:" << storeBytes / BENCHMARK_NOTE_COUNT;
+    QVERIFY(storeBytes < objectBytes);
+
+    delete model;
+}
+
+/*!
+ * \brief tst_NoteModel::benchmarkScroll
+ * Read the title and date of every note as the delegate does when painting,
+ * through QVariants: from a list of LegacyNote objects with QDateTime dates,
+ * as the model used to hold them, and from the model
+ */
+void tst_NoteModel::benchmarkScroll()
+{
+    QList<NoteData*> noteList = generateNotes(BENCHMARK_NOTE_COUNT);
+    QList<LegacyNote*> legacyNotes;
+    legacyNotes.reserve(noteList.size());
+    for(NoteData* note : noteList){
+        LegacyNote* legacyNote = new LegacyNote;
+        legacyNote->id = note->id();
+        legacyNote->fullTitle = note->fullTitle();
+        legacyNote->lastModificationDateTime = QDateTime::fromMSecsSinceEpoch(note->lastModificationDate());
+        legacyNote->creationDateTime = QDateTime::fromMSecsSinceEpoch(note->creationDate());
+        legacyNote->isModified = false;
+        legacyNote->isSelected = false;
+        legacyNote->scrollBarPosition = 0;
+        legacyNotes.append(legacyNote);
+    }
+    NoteModel model;
+    model.addListNote(noteList);
+
+    const int passCount = 10;
+    qint64 checksum = 0;
+    QElapsedTimer timer;
+
+    timer.start();
+    for(int pass = 0; pass < passCount; ++pass){
+        for(int row = 0; row < legacyNotes.size(); ++row){
+            LegacyNote* note = legacyNotes.at(row);
+            checksum += QVariant(note->fullTitle).toString().size();
+            checksum += QVariant(note->lastModificationDateTime).toDateTime().toMSecsSinceEpoch();
+        }
+    }
+    qint64 objectTime = timer.restart();
+
+    for(int pass = 0; pass < passCount; ++pass){
+        for(int row = 0; row < model.rowCount(); ++row){
+            QModelIndex index = model.index(row);
+            checksum -= model.data(index, NoteModel::NoteFullTitle).toString().size();
+            checksum -= model.data(index, NoteModel::NoteLastModificationDateTime).toLongLong();
+        }
+    }
+    qint64 storeTime = timer.elapsed();
+
+    qDebug() << passCount << "passes over" << BENCHMARK_NOTE_COUNT << "notes, objects:" << objectTime
+             << "ms, model:" << storeTime << "ms";
+    QCOMPARE(checksum, qint64(0));
+
+    qDeleteAll(legacyNotes);
+}
+
+/*!
+ * \brief tst_NoteModel::benchmarkSort
+ * Sort shuffled notes by modification date as objects and while adding them to the model
+ */
+void tst_NoteModel::benchmarkSort()
+{
+    QList<NoteData*> noteList = generateNotes(BENCHMARK_NOTE_COUNT);
+    std::mt19937 generator(42);
+    std::shuffle(noteList.begin(), noteList.end(), generator);
+
+    QList<NoteData*> copies;
+    for(NoteData* note : noteList)
+        copies.append(note->clone());
+    NoteModel model;
+
+    QElapsedTimer timer;
+    timer.start();
+    std::stable_sort(noteList.begin(), noteList.end(), [](NoteData* lhs, NoteData* rhs){
+        return lhs->lastModificationdateTime() > rhs->lastModificationdateTime();
+    });
+    qint64 objectTime = timer.restart();
+
+    model.addListNote(copies);
+    qint64 storeTime = timer.elapsed();
+
+    qDebug() << "sorting" << BENCHMARK_NOTE_COUNT << "notes, objects:" << objectTime
+             << "ms, model:" << storeTime << "ms";
+
+    for(int row = 0; row < model.rowCount(); ++row)
+        QCOMPARE(model.data(model.index(row), NoteModel::NoteID).toInt(), noteList.at(row)->id());
+
+    qDeleteAll(noteList);
+}
+
+/*!
+ * \brief tst_NoteModel::benchmarkImport
+ * Merge a small import spread across a large notes list,
+ * against reloading the whole list as the imports used to
+ */
+void tst_NoteModel::benchmarkImport()
+{
+    const int importCount = 1000;
+    QList<NoteData*> noteList = generateNotes(BENCHMARK_NOTE_COUNT);
+    qint64 latest = noteList.first()->lastModificationDate();
+
+    QList<NoteData*> importList;
+    std::mt19937 generator(42);
+    std::uniform_int_distribution<int> ageDistribution(0, BENCHMARK_NOTE_COUNT * 1000);
+    for(int i = 0; i < importCount; ++i){
+        NoteData* note = new NoteData();
+        note->setId(BENCHMARK_NOTE_COUNT + i + 1);
+        note->setLastModificationDate(latest - ageDistribution(generator) - 1);
+        note->setCreationDate(note->lastModificationDate());
+        note->setFullTitle(QStringLiteral("Imported note %1").arg(i));
+        importList.append(note);
+    }
+
+    auto cloneAll = [](const QList<NoteData*>& notes){
+        QList<NoteData*> copies;
+        copies.reserve(notes.size());
+        for(NoteData* note : notes)
+            copies.append(note->clone());
+        return copies;
+    };
+
+    NoteModel mergedModel;
+    mergedModel.addListNote(cloneAll(noteList));
+    QSignalSpy insertedSpy(&mergedModel, SIGNAL(rowsInserted(QModelIndex,int,int)));
+
+    NoteModel reloadedModel;
+    reloadedModel.addListNote(cloneAll(noteList));
+    QList<NoteData*> reloadList = cloneAll(noteList) + cloneAll(importList);
+
+    QElapsedTimer timer;
+    timer.start();
+    mergedModel.addListNote(importList);
+    qint64 mergeTime = timer.restart();
+
+    reloadedModel.clearNotes();
+    std::stable_sort(reloadList.begin(), reloadList.end(), [](NoteData* lhs, NoteData* rhs){
+        return lhs->lastModificationDate() > rhs->lastModificationDate();
+    });
+    reloadedModel.addListNote(reloadList);
+    qint64 reloadTime = timer.elapsed();
+
+    qDebug() << "importing" << importCount << "notes into" << BENCHMARK_NOTE_COUNT << "notes, merged:"
+             << mergeTime << "ms in" << insertedSpy.count() << "inserts, reloaded:" << reloadTime << "ms";
+
+    QCOMPARE(mergedModel.rowCount(), reloadedModel.rowCount());
+    for(int row = 0; row < mergedModel.rowCount(); ++row)
+        QCOMPARE(mergedModel.data(mergedModel.index(row), NoteModel::NoteID).toInt(),
+                 reloadedModel.data(reloadedModel.index(row), NoteModel::NoteID).toInt());
+
+    qDeleteAll(noteList);
+}
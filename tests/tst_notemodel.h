@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QtTest>
+#include "../src/notedata.h"
 
 class tst_NoteModel : public QObject
 {
@@ -13,6 +14,14 @@ public:
 private Q_SLOTS:
     void initTestCase();
     void cleanupTestCase();
+    void testNoteStore();
+    void testContentCache();
+    void testSortedInsertion();
+    void testBatchUpdates();
+    void benchmarkMemory();
+    void benchmarkScroll();
+    void benchmarkSort();
+    void benchmarkImport();
 };
 
 #endif // TST_NOTEMODEL_H